@@ -44,10 +44,11 @@ absyn_new_subscript_var (int        pos,
 {
   absyn_var *v = new (sizeof(*v));
 
-  v->kind            = ABSYN_SUBSCRIPT_VAR;
-  v->pos             = pos;
-  v->u.subscript.var = var_ptr;
-  v->u.subscript.exp = exp_ptr;
+  v->kind                 = ABSYN_SUBSCRIPT_VAR;
+  v->pos                  = pos;
+  v->u.subscript.var      = var_ptr;
+  v->u.subscript.exp      = exp_ptr;
+  v->u.subscript.in_range = false;
 
   return v;
 }
@@ -301,6 +302,7 @@ absyn_new_var_dec (int         pos,
   d->u.var.typ    = typ_ptr;
   d->u.var.init   = init_ptr;
   d->u.var.escape = true;
+  d->u.var.local_record = false;
 
   return d;
 }
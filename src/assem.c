@@ -35,6 +35,20 @@ assem_new_targets (temp_label_list *labels)
   assem_targets *p = new (sizeof *p);
 
   p->labels = labels;
+  p->uncond = false;
+
+  return p;
+}
+
+/**
+ * Targets of a jump that is always taken.
+ */
+assem_targets *
+assem_new_uncond_targets (temp_label_list *labels)
+{
+  assem_targets *p = assem_new_targets (labels);
+
+  p->uncond = true;
 
   return p;
 }
@@ -0,0 +1,397 @@
+/**
+ * @file bounds.c
+ * Goes through abstract syntax tree and looks for array subscripts that
+ * are always in range.
+ *
+ * Values get described as a variable plus a constant. The variable has to
+ * keep its value, so it must never be assigned. A for loop variable i lies
+ * in [lo, hi] and an array variable a has the length its array expression
+ * was created with. a[i+k] is in range if lo+k >= 0 and hi+k is less than
+ * the length, with hi and the length based on the same variable. The first
+ * pass collects the assigned variables, the second one marks the
+ * subscripts. Overflows in the bounds and sizes are not considered.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "include/errormsg.h"
+#include "include/symbol.h"
+#include "include/table.h"
+#include "include/util.h"
+#include "include/bounds.h"
+
+
+typedef struct _bnd_bound bnd_bound;
+typedef struct _bnd_entry bnd_entry;
+
+/* The value var + c, var is NULL for a constant */
+struct
+_bnd_bound
+{
+  bool       known;
+  bnd_entry *var;
+  long       c;
+};
+
+struct
+_bnd_entry
+{
+  void      *key;    /* Declaration of the variable, NULL for functions */
+  bool       loop;   /* For loop variable, lies in [lo, hi] */
+  bnd_bound  lo;
+  bnd_bound  hi;
+  bnd_bound  length; /* Length of the array the variable got created with */
+};
+
+static tab_table *assigned; /* Keys of the variables that get assigned */
+static bool       marking;  /* Second pass, marks the subscripts */
+
+/* Local function declaration */
+
+static void        traverse_exp     (sym_table *env_ptr,
+                                     absyn_exp *exp_ptr);
+
+static void        traverse_dec     (sym_table *env_ptr,
+                                     absyn_dec *dec_ptr);
+
+static void        traverse_var     (sym_table *env_ptr,
+                                     absyn_var *var_ptr);
+
+static void        traverse_formals (sym_table         *env_ptr,
+                                     absyn_fundec_list *fundec_list_ptr);
+
+static bnd_entry * new_bnd_entry    (void *key);
+
+static bnd_bound   bound_of         (sym_table *env_ptr,
+                                     absyn_exp *exp_ptr);
+
+
+
+/**
+ * Marks the subscripts that can not be out of range with in_range.
+ *
+ * @param exp_ptr Expression to check.
+ */
+void
+bnd_find_safe_subscripts (absyn_exp *exp_ptr)
+{
+  assigned = tab_new_table ();
+
+  marking = false;
+  traverse_exp (sym_new_table (), exp_ptr);
+  marking = true;
+  traverse_exp (sym_new_table (), exp_ptr);
+}
+
+
+static void
+traverse_exp (sym_table *env_ptr,
+              absyn_exp *exp_ptr)
+{
+  if (exp_ptr == NULL)
+    return;
+
+  switch (exp_ptr->kind)
+    {
+    case ABSYN_VAR_EXP:
+      return traverse_var (env_ptr, exp_ptr->u.var);
+
+    case ABSYN_CALL_EXP:
+      {
+        absyn_exp_list *list = exp_ptr->u.call.args;
+        for (; list != NULL; list = list->tail)
+          traverse_exp (env_ptr, list->head);
+        return;
+      }
+
+    case ABSYN_RECORD_EXP:
+      {
+        absyn_efield_list *list = exp_ptr->u.record.fields;
+        for (; list != NULL; list = list->tail)
+          traverse_exp (env_ptr, list->head->exp);
+        return;
+      }
+
+    case ABSYN_SEQ_EXP:
+      {
+        absyn_exp_list *list = exp_ptr->u.seq;
+        for (; list != NULL; list = list->tail)
+          traverse_exp (env_ptr, list->head);
+        return;
+      }
+
+    case ABSYN_IF_EXP:
+      traverse_exp (env_ptr, exp_ptr->u.iff.test);
+      traverse_exp (env_ptr, exp_ptr->u.iff.then);
+      traverse_exp (env_ptr, exp_ptr->u.iff.elsee);
+      return;
+
+    case ABSYN_WHILE_EXP:
+      traverse_exp (env_ptr, exp_ptr->u.whilee.test);
+      traverse_exp (env_ptr, exp_ptr->u.whilee.body);
+      return;
+
+    case ABSYN_FOR_EXP:
+      {
+        traverse_exp (env_ptr, exp_ptr->u.forr.lo);
+        traverse_exp (env_ptr, exp_ptr->u.forr.hi);
+
+        bnd_entry *loop = new_bnd_entry (exp_ptr);
+        loop->loop = true;
+        loop->lo   = bound_of (env_ptr, exp_ptr->u.forr.lo);
+        loop->hi   = bound_of (env_ptr, exp_ptr->u.forr.hi);
+
+        sym_begin_scope (env_ptr);
+        sym_bind_symbol (env_ptr, exp_ptr->u.forr.var, loop);
+        traverse_exp (env_ptr, exp_ptr->u.forr.body);
+        sym_end_scope (env_ptr);
+        return;
+      }
+
+    case ABSYN_ARRAY_EXP:
+      traverse_exp (env_ptr, exp_ptr->u.array.size);
+      traverse_exp (env_ptr, exp_ptr->u.array.init);
+      return;
+
+    case ABSYN_LET_EXP:
+      {
+        sym_begin_scope (env_ptr);
+
+        absyn_dec_list *list = exp_ptr->u.let.decs;
+        for (; list != NULL; list = list->tail)
+          traverse_dec (env_ptr, list->head);
+
+        traverse_exp (env_ptr, exp_ptr->u.let.body);
+        sym_end_scope (env_ptr);
+        return;
+      }
+
+    case ABSYN_OP_EXP:
+      traverse_exp (env_ptr, exp_ptr->u.op.left);
+      traverse_exp (env_ptr, exp_ptr->u.op.right);
+      return;
+
+    case ABSYN_ASSIGN_EXP:
+      {
+        absyn_var *var_ptr = exp_ptr->u.assign.var;
+        if (var_ptr->kind == ABSYN_SIMPLE_VAR)
+          {
+            bnd_entry *entry = sym_lookup (env_ptr, var_ptr->u.simple);
+            if (entry != NULL && entry->key != NULL)
+              tab_bind_value (assigned, entry->key, entry->key);
+          }
+        traverse_var (env_ptr, var_ptr);
+        traverse_exp (env_ptr, exp_ptr->u.assign.exp);
+        return;
+      }
+
+    case ABSYN_NIL_EXP:
+    case ABSYN_INT_EXP:
+    case ABSYN_STR_EXP:
+    case ABSYN_BREAK_EXP:
+      return;
+    }
+  errm_impossible ("Got over switch in traverse_exp()!\n");
+}
+
+static void
+traverse_dec (sym_table *env_ptr,
+              absyn_dec *dec_ptr)
+{
+  if (dec_ptr == NULL)
+    return;
+
+  switch (dec_ptr->kind)
+    {
+    case ABSYN_FUNCTION_DEC:
+      {
+        /* Functions hide variables with the same name */
+        absyn_fundec_list *list = dec_ptr->u.function;
+        for (; list != NULL; list = list->tail)
+          sym_bind_symbol (env_ptr, list->head->name, new_bnd_entry (NULL));
+
+        return traverse_formals (env_ptr, dec_ptr->u.function);
+      }
+
+    case ABSYN_TYPE_DEC:
+      return;
+
+    case ABSYN_VAR_DEC:
+      {
+        traverse_exp (env_ptr, dec_ptr->u.var.init);
+
+        bnd_entry *entry = new_bnd_entry (dec_ptr);
+        if (dec_ptr->u.var.init->kind == ABSYN_ARRAY_EXP)
+          entry->length = bound_of (env_ptr, dec_ptr->u.var.init->u.array.size);
+        sym_bind_symbol (env_ptr, dec_ptr->u.var.var, entry);
+        return;
+      }
+    }
+  errm_impossible ("Got over switch in traverse_dec()!\n");
+}
+
+static bool
+immutable (bnd_entry *entry)
+{
+  return entry != NULL
+    && entry->key != NULL
+    && tab_lookup (assigned, entry->key) == NULL;
+}
+
+/*
+  Checks a[i+k] or a[k]. The array variable has to keep the array it got
+  created with.
+*/
+static bool
+in_range (sym_table *env_ptr,
+          absyn_var *var_ptr)
+{
+  absyn_var *array_ptr = var_ptr->u.subscript.var;
+  if (array_ptr->kind != ABSYN_SIMPLE_VAR)
+    return false;
+
+  bnd_entry *array = sym_lookup (env_ptr, array_ptr->u.simple);
+  if (!immutable (array) || !array->length.known)
+    return false;
+
+  bnd_bound length = array->length;
+  bnd_bound index  = bound_of (env_ptr, var_ptr->u.subscript.exp);
+  if (!index.known)
+    return false;
+
+  if (index.var == NULL)
+    return length.var == NULL && index.c >= 0 && index.c < length.c;
+
+  bnd_entry *loop = index.var;
+  return loop->loop
+    && loop->lo.known && loop->lo.var == NULL && loop->lo.c + index.c >= 0
+    && loop->hi.known && loop->hi.var == length.var
+    && loop->hi.c + index.c < length.c;
+}
+
+static void
+traverse_var (sym_table *env_ptr,
+              absyn_var *var_ptr)
+{
+  if (var_ptr == NULL)
+    return;
+
+  switch (var_ptr->kind)
+    {
+    case ABSYN_SIMPLE_VAR:
+      return;
+
+    case ABSYN_FIELD_VAR:
+      return traverse_var (env_ptr, var_ptr->u.field.var);
+
+    case ABSYN_SUBSCRIPT_VAR:
+      traverse_var (env_ptr, var_ptr->u.subscript.var);
+      traverse_exp (env_ptr, var_ptr->u.subscript.exp);
+      if (marking)
+        var_ptr->u.subscript.in_range = in_range (env_ptr, var_ptr);
+      return;
+    }
+
+  errm_impossible ("Got over switch in traverse_var()!\n");
+}
+
+/*
+  Describes the value of an expression as variable plus constant,
+  if the expression is built like that.
+*/
+static bnd_bound
+bound_of (sym_table *env_ptr,
+          absyn_exp *exp_ptr)
+{
+  bnd_bound b = { false, NULL, 0 };
+
+  switch (exp_ptr->kind)
+    {
+    case ABSYN_INT_EXP:
+      b.known = true;
+      b.c     = exp_ptr->u.intt;
+      return b;
+
+    case ABSYN_VAR_EXP:
+      if (exp_ptr->u.var->kind == ABSYN_SIMPLE_VAR)
+        {
+          bnd_entry *entry = sym_lookup (env_ptr, exp_ptr->u.var->u.simple);
+          if (immutable (entry))
+            {
+              b.known = true;
+              b.var   = entry;
+            }
+        }
+      return b;
+
+    case ABSYN_OP_EXP:
+      {
+        if (exp_ptr->u.op.op != ABSYN_PLUS_OP
+            && exp_ptr->u.op.op != ABSYN_MINUS_OP)
+          return b;
+
+        bnd_bound l = bound_of (env_ptr, exp_ptr->u.op.left);
+        bnd_bound r = bound_of (env_ptr, exp_ptr->u.op.right);
+        if (!l.known || !r.known)
+          return b;
+
+        if (exp_ptr->u.op.op == ABSYN_PLUS_OP && (l.var == NULL || r.var == NULL))
+          {
+            b.known = true;
+            b.var   = l.var != NULL ? l.var : r.var;
+            b.c     = l.c + r.c;
+          }
+        else if (exp_ptr->u.op.op == ABSYN_MINUS_OP && r.var == NULL)
+          {
+            b.known = true;
+            b.var   = l.var;
+            b.c     = l.c - r.c;
+          }
+        return b;
+      }
+
+    default:
+      return b;
+    }
+}
+
+static bnd_entry *
+new_bnd_entry (void *key)
+{
+  bnd_entry *entry = new (sizeof (*entry));
+
+  entry->key          = key;
+  entry->loop         = false;
+  entry->lo.known     = false;
+  entry->hi.known     = false;
+  entry->length.known = false;
+
+  return entry;
+}
+
+/*
+  Go trough parameter list of function, declare the parameters,
+  so they hide variables with the same name, and then process body
+*/
+static void
+traverse_formals (sym_table         *env_ptr,
+                  absyn_fundec_list *fundec_list_ptr)
+{
+  absyn_fundec_list *list = fundec_list_ptr;
+  for (; list != NULL; list = list->tail)
+    {
+      sym_begin_scope (env_ptr);
+
+      absyn_fundec     *fundec      = list->head;
+      absyn_field_list *params_list = fundec->params;
+
+      for (; params_list != NULL; params_list = params_list->tail)
+        sym_bind_symbol (env_ptr,
+                         params_list->head->name,
+                         new_bnd_entry (params_list->head));
+
+      traverse_exp (env_ptr, fundec->body);
+      sym_end_scope (env_ptr);
+    }
+}
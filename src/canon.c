@@ -35,12 +35,11 @@ _exp_ref_list
 
 static tree_stm *            do_stm    (tree_stm *stm);
 
-static stm_exp *             do_exp    (tree_exp *exp);
+static tree_stm *            do_seq    (tree_stm *stm);
 
-static canon_stmlist_list *  mk_blocks (tree_stm_list *stms,
-                                        temp_label    *done);
+static stm_exp *             do_exp    (tree_exp *exp);
 
-static tree_stm_list *       get_next  (void);
+static tree_stm_list *       linear    (tree_stm *stm);
 
 /* End local function prototypes */
 
@@ -197,7 +196,7 @@ do_stm (tree_stm *stm)
   switch (stm->kind)
     {
     case TREE_SEQ:
-      return seq(do_stm(stm->u.seq.left), do_stm(stm->u.seq.right));
+      return do_seq (stm);
 
     case TREE_JUMP:
       return seq (reorder (new_exp_ref_list (&stm->u.jmp.exp, NULL)), stm);
@@ -230,7 +229,9 @@ do_stm (tree_stm *stm)
       assert(0); /* dst should be temp or mem only */
 
     case TREE_EXP:
-      if (stm->u.exp->kind == TREE_CALL)
+      if (stm->u.exp->kind == TREE_ESEQ)
+        return do_seq (stm);
+      else if (stm->u.exp->kind == TREE_CALL)
         return seq (reorder (get_call_ref_list (stm->u.exp)), stm);
       else
         return seq (reorder (new_exp_ref_list (&stm->u.exp, NULL)), stm);
@@ -240,14 +241,60 @@ do_stm (tree_stm *stm)
     }
 }
 
-/* linear gets rid of the top-level SEQ's, producing a list */
+/*
+  Processes the statements of a SEQ one after the other. Sequences are
+  long chains of SEQs or of EXP(ESEQ(..)), this keeps them off the C stack.
+*/
+static tree_stm *
+do_seq (tree_stm *stm)
+{
+  tree_stm_list *l, *rdone = NULL;
+  tree_stm      *s     = tree_new_exp (tree_new_const (0)); /* nop */
+
+  for (l = linear (stm); l; l = l->tail)
+    rdone = tree_new_stm_list (do_stm (l->head), rdone);
+
+  for (; rdone; rdone = rdone->tail)
+    s = seq (rdone->head, s);
+
+  return s;
+}
+
+/*
+  linear gets rid of the top-level SEQ's, producing a list. EXP(ESEQ(s,e))
+  is the same as SEQ(s,EXP(e)) and gets flattened too. Uses a stack of the
+  statements still to visit instead of recursion.
+*/
 static tree_stm_list *
-linear (tree_stm *stm, tree_stm_list *right)
+linear (tree_stm *stm)
 {
-  if (stm->kind == TREE_SEQ)
-    return linear (stm->u.seq.left, linear (stm->u.seq.right, right));
-  else
-    return tree_new_stm_list (stm, right);
+  tree_stm_list  *stack = tree_new_stm_list (stm, NULL);
+  tree_stm_list  *list  = NULL;
+  tree_stm_list **tail  = &list;
+
+  while (stack)
+    {
+      stm   = stack->head;
+      stack = stack->tail;
+
+      if (stm->kind == TREE_SEQ)
+        {
+          stack = tree_new_stm_list (stm->u.seq.right, stack);
+          stack = tree_new_stm_list (stm->u.seq.left, stack);
+        }
+      else if (stm->kind == TREE_EXP && stm->u.exp->kind == TREE_ESEQ)
+        {
+          stack = tree_new_stm_list (tree_new_exp (stm->u.exp->u.eseq.exp),
+                                     stack);
+          stack = tree_new_stm_list (stm->u.exp->u.eseq.stm, stack);
+        }
+      else
+        {
+          *tail = tree_new_stm_list (stm, NULL);
+          tail  = &(*tail)->tail;
+        }
+    }
+  return list;
 }
 
 /**
@@ -263,65 +310,16 @@ linear (tree_stm *stm, tree_stm_list *right)
 tree_stm_list *
 canon_linearize (tree_stm *stm)
 {
-  return linear (do_stm (stm), NULL);
-}
-
-/* Go down a list looking for end of basic block */
-static canon_stmlist_list *
-next (tree_stm_list *prevstms,
-      tree_stm_list *stms,
-      temp_label    *done)
-{
-  if (!stms)
-    return next (prevstms,
-                 tree_new_stm_list (tree_new_jump (tree_new_name (done),
-                                                   temp_new_label_list (done,
-                                                                        NULL)),
-                                    NULL),
-                 done);
-
-  tree_stm *stm = stms->head;
-  if (stm->kind == TREE_JUMP || stm->kind == TREE_CJUMP)
-    {
-      prevstms->tail = stms;
-      canon_stmlist_list *stmlist_list = mk_blocks (stms->tail, done);
-      stms->tail = NULL;
-      return stmlist_list;
-  }
-  else if (stm->kind == TREE_LABEL)
-    {
-      temp_label *lab = stm->u.label;
-      return next (prevstms, tree_new_stm_list (tree_new_jump (tree_new_name (lab),
-                                                               temp_new_label_list (lab,
-                                                                                    NULL)),
-                                                stms),
-                   done);
-    }
-  else
-    {
-      prevstms->tail = stms;
-      return next (stms, stms->tail, done);
-    }
+  return linear (do_stm (stm));
 }
 
-/* Create the beginning of a basic block */
-static canon_stmlist_list *
-mk_blocks (tree_stm_list *stms,
-           temp_label    *done)
+/* Returns a list with a jump to label */
+static tree_stm_list *
+jump_to (temp_label *label)
 {
-  if (!stms)
-    {
-      return NULL;
-    }
-  tree_stm *stm = stms->head;
-  if (stm->kind != TREE_LABEL)
-    {
-      return mk_blocks (tree_new_stm_list (tree_new_label (temp_new_label()),
-                                           stms),
-                        done);
-    }
-  /* else there already is a label */
-  return canon_new_stmlist_list (stms, next(stms, stms->tail, done));
+  return tree_new_stm_list (tree_new_jump (tree_new_name (label),
+                                           temp_new_label_list (label, NULL)),
+                            NULL);
 }
 
 /**
@@ -343,113 +341,49 @@ mk_blocks (tree_stm_list *stms,
 canon_block
 canon_basic_blocks (tree_stm_list *stm_list)
 {
-  canon_block b;
+  canon_block          b;
+  canon_stmlist_list **blocks = &b.stm_lists;
+  tree_stm_list       *stms   = stm_list;
 
   b.label     = temp_new_label ();
-  b.stm_lists = mk_blocks (stm_list, b.label);
-
-  return b;
-}
-
-static sym_table   *block_env;
-static canon_block  global_block;
-
-static tree_stm_list *
-get_last(tree_stm_list *list)
-{
-  tree_stm_list *last = list;
-  while (last->tail->tail)
-    last = last->tail;
+  b.stm_lists = NULL;
 
-  return last;
-}
+  while (stms)
+    {
+      /* Create the beginning of a basic block */
+      if (stms->head->kind != TREE_LABEL)
+        stms = tree_new_stm_list (tree_new_label (temp_new_label ()), stms);
 
-static void
-trace (tree_stm_list *list)
-{
-  tree_stm_list *last = get_last (list);
-  tree_stm      *lab  = list->head;
-  tree_stm      *s    = last->tail->head;
+      tree_stm_list *block = stms;
+      tree_stm_list *last  = stms;
 
-  sym_bind_symbol (block_env, lab->u.label, NULL);
-  if (s->kind == TREE_JUMP)
-    {
-      tree_stm_list *target = (tree_stm_list*) sym_lookup (block_env,
-                                                         s->u.jmp.jumps->head);
-      if (!s->u.jmp.jumps->tail && target)
-        {
-          last->tail = target; /* merge the 2 lists removing JUMP stm */
-          trace (target);
-        }
-      else
-        {
-          last->tail->tail = get_next(); /* merge and keep JUMP stm */
-        }
-    }
-  /* we want false label to follow CJUMP */
-  else if (s->kind == TREE_CJUMP)
-    {
-      tree_stm_list *truee  = (tree_stm_list*) sym_lookup (block_env,
-                                                         s->u.cjump.truee);
-      tree_stm_list *falsee = (tree_stm_list*) sym_lookup (block_env,
-                                                           s->u.cjump.falsee);
-      if (falsee)
-        {
-          last->tail->tail = falsee;
-          trace(falsee);
-        }
-      else if (truee)
-        { /* convert so that existing label is a false label */
-          last->tail->head = tree_new_cjump (tree_not_rel (s->u.cjump.op),
-                                             s->u.cjump.left,
-                                             s->u.cjump.right,
-                                             s->u.cjump.falsee,
-                                             s->u.cjump.truee);
-          last->tail->tail = truee;
-          trace(truee);
-        }
-      else
+      /* Go down the list looking for the end of the basic block */
+      for (stms = stms->tail; ; last = stms, stms = stms->tail)
         {
-          temp_label *falsee = temp_new_label ();
-          last->tail->head = tree_new_cjump (s->u.cjump.op,
-                                             s->u.cjump.left,
-                                             s->u.cjump.right,
-                                             s->u.cjump.truee,
-                                             falsee);
-          last->tail->tail = tree_new_stm_list (tree_new_label (falsee),
-                                                get_next ());
+          if (!stms)
+            {
+              last->tail = jump_to (b.label);
+              break;
+            }
+          else if (stms->head->kind == TREE_JUMP
+                   || stms->head->kind == TREE_CJUMP)
+            {
+              stms             = stms->tail;
+              last->tail->tail = NULL;
+              break;
+            }
+          else if (stms->head->kind == TREE_LABEL)
+            {
+              last->tail = jump_to (stms->head->u.label);
+              break;
+            }
         }
-    }
-  else
-    {
-      assert(0);
-    }
-}
 
-/* get the next block from the list of stmLists, using only those that have
- * not been traced yet */
-static tree_stm_list *
-get_next ()
-{
-  if (!global_block.stm_lists)
-    {
-      return tree_new_stm_list (tree_new_label (global_block.label), NULL);
-    }
-  else
-    {
-      tree_stm_list *s = global_block.stm_lists->head;
-      tree_stm *stm    = s->head;
-      if (sym_lookup (block_env, stm->u.label))
-        {/* label exists in the table */
-          trace(s);
-          return s;
-        }
-      else
-        {
-          global_block.stm_lists = global_block.stm_lists->tail;
-          return get_next ();
-        }
+      *blocks = canon_new_stmlist_list (block, NULL);
+      blocks  = &(*blocks)->tail;
     }
+
+  return b;
 }
 
 /**
@@ -470,17 +404,88 @@ get_next ()
 tree_stm_list *
 canon_trace_schedule (canon_block b)
 {
-  canon_stmlist_list *stmlist_list;
-  block_env    = sym_new_table ();
-  global_block = b;
+  canon_stmlist_list  *bl;
+  sym_table           *block_env = sym_new_table ();
+  tree_stm_list       *list      = NULL;
+  tree_stm_list      **tail      = &list;
+
+  /* Blocks not traced yet are bound to their label */
+  for (bl = b.stm_lists; bl; bl = bl->tail)
+    sym_bind_symbol (block_env, bl->head->head->u.label, bl->head);
 
-  for (stmlist_list = global_block.stm_lists;
-       stmlist_list;
-       stmlist_list = stmlist_list->tail)
+  for (bl = b.stm_lists; bl; bl = bl->tail)
     {
-      tree_stm_list *stm_list = stmlist_list->head;
-      tree_stm      *stm      = stm_list->head;
-      sym_bind_symbol (block_env, stm->u.label, stmlist_list->head);
+      tree_stm_list *block = bl->head;
+
+      if (!sym_lookup (block_env, block->head->u.label))
+        continue;
+
+      /* Follow a trace until it reaches a block already traced */
+      while (block)
+        {
+          tree_stm_list *last = block, *jmp;
+          tree_stm      *s;
+
+          sym_bind_symbol (block_env, block->head->u.label, NULL);
+          *tail = block;
+
+          while (last->tail->tail)
+            last = last->tail;
+          jmp = last->tail;
+          s   = jmp->head;
+          tail  = &jmp->tail;
+          block = NULL;
+
+          if (s->kind == TREE_JUMP)
+            {
+              tree_stm_list *target = sym_lookup (block_env,
+                                                  s->u.jmp.jumps->head);
+              if (!s->u.jmp.jumps->tail && target)
+                {
+                  tail  = &last->tail; /* merge removing JUMP stm */
+                  block = target;
+                }
+            }
+          /* we want false label to follow CJUMP */
+          else if (s->kind == TREE_CJUMP)
+            {
+              tree_stm_list *truee  = sym_lookup (block_env,
+                                                  s->u.cjump.truee);
+              tree_stm_list *falsee = sym_lookup (block_env,
+                                                  s->u.cjump.falsee);
+              if (falsee)
+                {
+                  block = falsee;
+                }
+              else if (truee)
+                { /* convert so that existing label is a false label */
+                  jmp->head = tree_new_cjump (tree_not_rel (s->u.cjump.op),
+                                              s->u.cjump.left,
+                                              s->u.cjump.right,
+                                              s->u.cjump.falsee,
+                                              s->u.cjump.truee);
+                  block = truee;
+                }
+              else
+                { /* new false label that jumps to the old one */
+                  temp_label *f = temp_new_label ();
+                  jmp->head = tree_new_cjump (s->u.cjump.op,
+                                              s->u.cjump.left,
+                                              s->u.cjump.right,
+                                              s->u.cjump.truee,
+                                              f);
+                  *tail = tree_new_stm_list (tree_new_label (f),
+                                             jump_to (s->u.cjump.falsee));
+                  tail  = &(*tail)->tail->tail;
+                }
+            }
+          else
+            {
+              assert(0);
+            }
+        }
     }
-  return get_next();
+  *tail = tree_new_stm_list (tree_new_label (b.label), NULL);
+
+  return list;
 }
@@ -13,6 +13,7 @@
 #include "include/assem.h"
 #include "include/frame.h"
 #include "include/graph.h"
+#include "include/flowgraph.h"
 #include "include/color.h"
 #include "include/liveness.h"
 #include "include/table.h"
@@ -23,7 +24,9 @@ struct
 ctx
 {
   graph_graph    *nodes;
+  tab_table      *node_of;  /* Temp to its node in nodes */
   temp_map       *precolored;
+  temp_temp_list *regs;
   temp_temp_list *initial;
   temp_temp_list *spill_work_list;
   temp_temp_list *freeze_work_list;
@@ -49,41 +52,6 @@ ctx
 
 static col_ctx c;
 
-static temp_temp_list *
-inst_def (assem_instr *inst)
-{
-  switch (inst->kind)
-    {
-    case I_OPER:
-      return inst->u.oper.dst;
-
-    case I_LABEL:
-      return NULL;
-
-    case I_MOVE:
-      return inst->u.move.dst;
-    default:
-      assert (0);
-    }
-}
-
-static temp_temp_list *
-inst_use (assem_instr *inst)
-{
-  switch (inst->kind)
-    {
-    case I_OPER:
-      return inst->u.oper.src;
-
-    case I_LABEL:
-      return NULL;
-
-    case I_MOVE:
-      return inst->u.move.src;
-  }
-  return NULL;
-}
-
 static temp_temp_list *
 clone_regs (temp_temp_list *regs)
 {
@@ -107,14 +75,7 @@ static graph_node *
 temp_to_node (temp_temp *t) {
   if (t == NULL)
     return NULL;
-  graph_node_list *nodes = graph_nodes(c.nodes);
-  graph_node_list *p;
-
-  for(p=nodes; p!=NULL; p=p->tail)
-    if (live_gtemp (p->head) == t)
-      return p->head;
-
-  return NULL;
+  return (graph_node*)tab_lookup (c.node_of, t);
 }
 
 static graph_node_list *
@@ -266,7 +227,7 @@ adjacent (temp_temp *t)
   temp_temp_list  *adjs = NULL;
   for (; adjn; adjn = adjn->tail)
     {
-      adjs = temp_new_temp_list (node_to_temp (n), adjs);
+      adjs = temp_new_temp_list (node_to_temp (adjn->head), adjs);
     }
   adjs = minus_temp (adjs, union_temp (c.select_stack, c.coalesced_nodes));
   return adjs;
@@ -324,7 +285,7 @@ make_work_list ()
       graph_node *n = temp_to_node (t);
       c.initial = minus_temp (c.initial, temp_new_temp_list (t, NULL));
 
-    if (graph_degree (n) >= c.k)
+    if ((long)graph_lookup (c.degree, n) >= c.k)
       {
         c.spill_work_list = union_temp (c.spill_work_list,
                                         temp_new_temp_list (t, NULL));
@@ -387,7 +348,8 @@ decrement_degree (graph_node *n)
   d -= 1;
   graph_bind (c.degree, n, (void*)d);
 
-  if (d == c.k)
+  /* The node just became insignificant */
+  if (d == c.k - 1)
     {
       enable_moves (temp_new_temp_list (t, adjacent(t)));
       c.spill_work_list = minus_temp (c.spill_work_list,
@@ -482,17 +444,14 @@ simplify ()
     }
 
   temp_temp  *t = c.simplify_work_list->head;
-  graph_node *n = temp_to_node (t);
   c.simplify_work_list = c.simplify_work_list->tail;
 
+  // Coalesced neighbors were already replaced by their alias
+  temp_temp_list *adjs = adjacent (t);
   c.select_stack = temp_new_temp_list (t, c.select_stack);  // push
 
-  graph_node_list *adjs = graph_adj(n);
   for (; adjs; adjs = adjs->tail)
-    {
-      graph_node *m = adjs->head;
-      decrement_degree (m);
-    }
+    decrement_degree (temp_to_node (adjs->head));
 }
 
 static void
@@ -524,18 +483,13 @@ combine (temp_temp *u,
 
   enable_moves (temp_new_temp_list (v, NULL));
 
-  //Temp_temp_list tadjs = adjacent(v);
-  //graph_node_list adjs = temp_list_to_node_list (tadjs);
-  graph_node_list *adjs = graph_adj (nv);
-  temp_temp_list *tadjs = node_list_to_temp_list (adjs);
-  for (; adjs; adjs = adjs->tail)
+  temp_temp_list *tadjs = adjacent (v);
+  for (; tadjs; tadjs = tadjs->tail)
     {
-      graph_node *nt = adjs->head;
-      nt = get_alias (nt);
+      graph_node *nt = temp_to_node (tadjs->head);
       add_edge (nt, nu);
       decrement_degree (nt);
     }
-  tadjs = NULL;
 
   long degree = (long)graph_lookup (c.degree, nu);
   if (degree >= c.k && in_temp (u, c.freeze_work_list))
@@ -556,8 +510,8 @@ coalesce ()
     }
 
   assem_instr *m = c.worklist_moves->head;
-  temp_temp *x = temp_head (inst_use (m));
-  temp_temp *y = temp_head (inst_def (m));
+  temp_temp *x = temp_head (fgraph_inst_use (m));
+  temp_temp *y = temp_head (fgraph_inst_def (m));
   temp_temp *u, *v;
 
   x = node_to_temp (get_alias (temp_to_node (x)));
@@ -635,8 +589,8 @@ freeze_moves (temp_temp *u)
   for (; il; il = il->tail)
     {
       assem_instr *m  = il->head;
-      temp_temp   *x  = temp_head (inst_use (m));
-      temp_temp   *y  = temp_head (inst_def (m));
+      temp_temp   *x  = temp_head (fgraph_inst_use (m));
+      temp_temp   *y  = temp_head (fgraph_inst_def (m));
       graph_node  *nx = temp_to_node (x);
       graph_node  *ny = temp_to_node (y);
       graph_node  *nv;
@@ -691,7 +645,7 @@ select_spill () {
     }
 
   temp_temp_list *tl                 = c.spill_work_list;
-  float           min_spill_priority = 9999.0f;
+  float           min_spill_priority = 0.0f;
   temp_temp      *m                  = NULL;
 
   for (; tl; tl = tl->tail)
@@ -701,7 +655,7 @@ select_spill () {
       long degree = (long)graph_lookup (c.degree, temp_to_node (t));
       degree = (degree > 0) ? degree : 1;
       float priority = ((float)cost) / degree;
-      if (priority < min_spill_priority)
+      if (m == NULL || priority < min_spill_priority)
         {
           min_spill_priority = priority;
           m = t;
@@ -742,71 +696,59 @@ color_main ()
          || c.spill_work_list != NULL);
 }
 
-struct col_result
-col_color (graph_graph      *ig,
-           temp_map         *initial,
-           temp_temp_list   *regs,
-           assem_instr_list *worklist_moves,
-           temp_map         *move_list,
-           temp_map         *spill_cost)
+/**
+ * Colors the nodes that are neither precolored nor coalesced. The
+ * coalesced nodes, their aliases and the coalesced moves are kept from
+ * the rounds before, everything else starts over.
+ */
+static struct col_result
+color_round (assem_instr_list *worklist_moves)
 {
-  //your code here.
   struct col_result ret;
 
-  c.precolored         = initial;
   c.initial            = NULL;
   c.simplify_work_list = NULL;
   c.freeze_work_list   = NULL;
   c.spill_work_list    = NULL;
   c.spilled_nodes      = NULL;
-  c.coalesced_nodes    = NULL;
   c.colored_nodes      = NULL;
   c.select_stack       = NULL;
 
-  c.coalesced_moves   = NULL;
   c.constrained_moves = NULL;
   c.frozen_moves      = NULL;
   c.worklist_moves    = worklist_moves;
   c.active_moves      = NULL;
 
-  c.spill_cost = spill_cost;
-  c.move_list  = move_list;
-  c.degree     = graph_new_table ();
-  c.alias      = graph_new_table ();
-  c.nodes      = ig;
+  c.degree = graph_new_table ();
 
-  c.k = count_temp (regs);
-
-
-  temp_map *precolored = initial;
-  temp_map *colors = temp_layer_map (temp_new_map (), initial);
-  temp_temp_list *spilled_nodes = NULL, *colored_nodes = NULL;
-  graph_node_list *nodes = graph_nodes (ig);
-  graph_node_list *temps = NULL;
+  temp_map *precolored = c.precolored;
+  temp_temp_list *regs = c.regs;
+  temp_map *colors = temp_layer_map (temp_new_map (), precolored);
+  temp_temp_list *colored_nodes = NULL;
 
   graph_node_list *nl;
-  for (nl = nodes; nl; nl = nl->tail)
+  for (nl = graph_nodes (c.nodes); nl; nl = nl->tail)
     {
-      long degree = graph_degree(nl->head);
-      graph_bind (c.degree, nl->head, (void*)degree);
-
-      if (temp_lookup (precolored, node_to_temp (nl->head)))
+      temp_temp *t = node_to_temp (nl->head);
+      if (temp_lookup (precolored, t))
         {
           graph_bind (c.degree, nl->head, (void*)999);
           continue;
         }
-      c.initial = temp_new_temp_list (node_to_temp (nl->head), c.initial);
+      if (in_temp (t, c.coalesced_nodes))
+        continue;
+
+      long degree = 0;
+      graph_node_list *adjs;
+      for (adjs = graph_adj (nl->head); adjs; adjs = adjs->tail)
+        if (!in_temp (node_to_temp (adjs->head), c.coalesced_nodes))
+          degree++;
+      graph_bind (c.degree, nl->head, (void*)degree);
+      c.initial = temp_new_temp_list (t, c.initial);
     }
 
   color_main ();
 
-  // for (nl = nodes; nl; nl = nl->tail) {
-  //   if (temp_lookup (precolored, node_to_temp (nl->head))) {
-  //     continue;
-  //   }
-  //   c.select_stack = L(node_to_temp (nl->head), c.select_stack);
-  // }
-
   while (c.select_stack != NULL)
     {
       temp_temp *t = c.select_stack->head; // pop
@@ -883,6 +825,86 @@ col_color (graph_graph      *ig,
   return ret;
 }
 
+/**
+ * Colors an interference graph from scratch.
+ *
+ * @param ig             The interference graph, coalescing adds edges to it.
+ * @param nodes          Table from temp to its node in ig.
+ * @param initial        The precolored temps.
+ * @param regs           The registers to color with.
+ * @param worklist_moves The moves to coalesce.
+ * @param move_list      Map from temp to the moves it occurs in.
+ * @param spill_cost     Map from temp to its spill cost (long).
+ */
+struct col_result
+col_color (graph_graph      *ig,
+           tab_table        *nodes,
+           temp_map         *initial,
+           temp_temp_list   *regs,
+           assem_instr_list *worklist_moves,
+           temp_map         *move_list,
+           temp_map         *spill_cost)
+{
+  c.precolored      = initial;
+  c.regs            = regs;
+  c.coalesced_nodes = NULL;
+  c.coalesced_moves = NULL;
+
+  c.spill_cost = spill_cost;
+  c.move_list  = move_list;
+  c.alias      = graph_new_table ();
+  c.nodes      = ig;
+  c.node_of    = nodes;
+
+  c.k = count_temp (regs);
+
+  return color_round (worklist_moves);
+}
+
+/**
+ * Colors the interference graph of the last col_color call again after
+ * spilling. The coalescing of the temps that remain is kept, so only the
+ * temps created by spilling start without an alias.
+ *
+ * @param moves   All moves of the function.
+ * @param removed The spilled temps, they are no longer in the graph.
+ */
+struct col_result
+col_recolor (assem_instr_list *moves,
+             temp_temp_list   *removed)
+{
+  assem_instr_list *worklist_moves = NULL;
+  temp_temp_list   *tl;
+
+  c.coalesced_nodes = minus_temp (c.coalesced_nodes, removed);
+
+  // Combining skips the neighbors on the select stack and a new temp only
+  // got edges to the coalesced temps, the alias interferes with all of them
+  for (tl = c.coalesced_nodes; tl; tl = tl->tail)
+    {
+      graph_node      *n     = temp_to_node (tl->head);
+      graph_node      *alias = get_alias (n);
+      graph_node_list *adjs;
+      for (adjs = graph_adj (n); adjs; adjs = adjs->tail)
+        {
+          graph_node *m = get_alias (adjs->head);
+          if (m != alias
+              && !graph_goes_to (m, alias) && !graph_goes_to (alias, m))
+            graph_add_edge (m, alias);
+        }
+    }
+
+  // Folding a spill can turn a move into another instruction
+  for (; moves; moves = moves->tail)
+    {
+      if (moves->head->kind == I_MOVE
+          && !inst_in (moves->head, c.coalesced_moves))
+        worklist_moves = assem_new_instr_list (moves->head, worklist_moves);
+    }
+
+  return color_round (worklist_moves);
+}
+
 static struct col_result
 col_color2 (graph_graph      *ig,
             temp_map         *initial,
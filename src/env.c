@@ -17,6 +17,24 @@ env_new_var_entry (tra_access *access_ptr,
   varentry->kind         = ENV_VAR_ENTRY;
   varentry->u.var.ty     = typ_ptr;
   varentry->u.var.access = access_ptr;
+  varentry->u.var.fields = NULL;
+  varentry->u.var.local_record = false;
+
+  return varentry;
+}
+
+/*
+  Variable of a record that got replaced by scalars.
+  Each field is accessed by its own access.
+*/
+env_enventry*
+env_new_record_entry (tra_access_list *fields_ptr,
+                      typ_ty          *typ_ptr)
+{
+  env_enventry *varentry = env_new_var_entry (NULL, typ_ptr);
+
+  varentry->u.var.fields       = fields_ptr;
+  varentry->u.var.local_record = true;
 
   return varentry;
 }
@@ -78,6 +96,24 @@ env_base_venv (void)
                                       temp_named_label ("getchar"),
                                       NULL,
                                       typ_new_str ()));
+  sym_bind_symbol (t,
+                   sym_new_symbol ("readline"),
+                   env_new_fun_entry (tra_outermost_level (),
+                                      temp_named_label ("readline"),
+                                      NULL,
+                                      typ_new_str ()));
+  sym_bind_symbol (t,
+                   sym_new_symbol ("readall"),
+                   env_new_fun_entry (tra_outermost_level (),
+                                      temp_named_label ("readall"),
+                                      NULL,
+                                      typ_new_str ()));
+  sym_bind_symbol (t,
+                   sym_new_symbol ("readint"),
+                   env_new_fun_entry (tra_outermost_level (),
+                                      temp_named_label ("readint"),
+                                      NULL,
+                                      typ_new_int ()));
   sym_bind_symbol (t,
                    sym_new_symbol ("ord"),
                    env_new_fun_entry (tra_outermost_level (),
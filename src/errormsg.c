@@ -58,22 +58,15 @@ errm_printf (int   pos,
              char *msg_ptr,
              ...)
 {
-  va_list   ap;
-  int_list *lines = line_pos;
-  int       num   = line_num;
+  va_list ap;
+  int     line, col;
 
   errm_any_errors = true;
 
-  while (lines && lines->i >= pos)
-    {
-      lines = lines->rest;
-      num--;
-    }
-
   if (file_name != NULL)
     fprintf (stderr, "%s:", file_name);
-  if (lines != NULL)
-    fprintf (stderr, "%d.%d: ", num, pos - lines->i);
+  if (errm_line_col (pos, &line, &col))
+    fprintf (stderr, "%d.%d: ", line, col);
 
   va_start (ap, msg_ptr);
   vfprintf (stderr, msg_ptr, ap);
@@ -81,6 +74,37 @@ errm_printf (int   pos,
   fprintf (stderr, "\n");
 }
 
+/**
+ * Finds line and column number of a position.
+ *
+ * @param pos      Position in the file.
+ * @param line_ptr Gets the line number.
+ * @param col_ptr  Gets the column number.
+ *
+ * @return False if the position is not in a known line.
+ */
+bool
+errm_line_col (int  pos,
+               int *line_ptr,
+               int *col_ptr)
+{
+  int_list *lines = line_pos;
+  int       num   = line_num;
+
+  while (lines && lines->i >= pos)
+    {
+      lines = lines->rest;
+      num--;
+    }
+
+  if (lines == NULL)
+    return false;
+
+  *line_ptr = num;
+  *col_ptr  = pos - lines->i;
+  return true;
+}
+
 /**
  * Prints a error message and then exits the application.
  *
@@ -3,6 +3,7 @@
  */
 #include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "include/util.h"
@@ -18,10 +19,12 @@
 #include "include/table.h"
 
 
+/**
+ * Returns the temps an instruction writes.
+ */
 temp_temp_list *
-fgraph_def (graph_node *n)
+fgraph_inst_def (assem_instr *inst)
 {
-  assem_instr *inst = (assem_instr*)graph_node_info (n);
   switch (inst->kind)
   {
     case I_OPER:
@@ -35,10 +38,12 @@ fgraph_def (graph_node *n)
   }
 }
 
+/**
+ * Returns the temps an instruction reads.
+ */
 temp_temp_list *
-fgraph_use (graph_node *n)
+fgraph_inst_use (assem_instr *inst)
 {
-  assem_instr *inst = (assem_instr*)graph_node_info (n);
   switch (inst->kind)
   {
     case I_OPER:
@@ -51,109 +56,235 @@ fgraph_use (graph_node *n)
   return NULL;
 }
 
-bool
-fgraph_is_move (graph_node *n)
+/**
+ * Replaces the temps an instruction reads and writes.
+ */
+void
+fgraph_set_temps (assem_instr    *inst,
+                  temp_temp_list *use,
+                  temp_temp_list *def)
+{
+  if (inst->kind == I_OPER)
+    {
+      inst->u.oper.src = use;
+      inst->u.oper.dst = def;
+    }
+  else if (inst->kind == I_MOVE)
+    {
+      inst->u.move.src = use;
+      inst->u.move.dst = def;
+    }
+}
+
+/**
+ * Loads a spilled temp from its slot at offset from the frame pointer.
+ */
+assem_instr *
+fgraph_spill_load (temp_temp *t,
+                   int        offset)
 {
-  assem_instr *inst = (assem_instr*)graph_node_info (n);
-  return (inst->kind == I_MOVE);
+  char buf[128];
+  sprintf (buf, "movl %d(`s0), `d0  # spilled\n", offset);
+  return assem_new_oper (string_new (buf),
+                         temp_new_temp_list (t, NULL),
+                         temp_new_temp_list (frm_fp (), NULL),
+                         NULL);
 }
 
+/**
+ * Stores a spilled temp to its slot at offset from the frame pointer.
+ */
 assem_instr *
-fgraph_inst (graph_node *n)
+fgraph_spill_store (temp_temp *t,
+                    int        offset)
+{
+  char buf[128];
+  sprintf (buf, "movl `s0, %d(`s1)  # spilled\n", offset);
+  return assem_new_oper (string_new (buf),
+                         NULL,
+                         temp_new_temp_list (t,
+                           temp_new_temp_list (frm_fp (), NULL)),
+                         NULL);
+}
+
+/**
+ * Checks if an instruction can jump to a label.
+ */
+bool
+fgraph_is_jump (assem_instr *inst)
+{
+  return inst->kind == I_OPER && inst->u.oper.jumps != NULL;
+}
+
+/**
+ * Checks if an instruction always jumps, only conditional jumps fall
+ * through to the next instruction.
+ */
+bool
+fgraph_is_uncond_jump (assem_instr *inst)
 {
-  return (assem_instr*)graph_node_info (n);
+  return fgraph_is_jump (inst) && inst->u.oper.jumps->uncond;
 }
 
-static graph_node *
-find_labeled_node (temp_label      *lab,
-                   graph_node_list *nl,
-                   temp_label_list *ll)
+/**
+ * Adds the edges from the blocks ending with a jump to the blocks of
+ * their targets.
+ *
+ * @param jumps  Blocks ending with a jump.
+ * @param labels Table from label to the block it starts.
+ */
+static void
+add_jump_edges (graph_node_list *jumps,
+                tab_table       *labels)
 {
-  graph_node *result = NULL;
-  for (; nl && ll; nl = nl->tail, ll = ll->tail)
+  for (; jumps; jumps = jumps->tail)
     {
-      if (ll->head == lab)
+      assem_instr     *last = fgraph_block_info (jumps->head)->last;
+      temp_label_list *jl   = last->u.oper.jumps->labels;
+      for (; jl; jl = jl->tail)
         {
-          result = nl->head;
-          return result;
+          graph_node *target = tab_lookup (labels, jl->head);
+          if (target != NULL)
+            graph_add_edge (jumps->head, target);
+          else
+            errm_printf (0, "fail to find node for label %s",
+                         temp_label_str (jl->head));
         }
     }
-  return result;
 }
 
+static fgraph_block *
+new_block (void)
+{
+  fgraph_block *b = new (sizeof (*b));
+  b->instrs = NULL;
+  b->last   = NULL;
+  b->use    = NULL;
+  b->def    = NULL;
+  return b;
+}
+
+fgraph_block *
+fgraph_block_info (graph_node *n)
+{
+  return (fgraph_block*)graph_node_info (n);
+}
+
+/**
+ * Builds a flow graph with one node for every basic block, in the order
+ * of the instructions. A block starts at a label or behind a jump.
+ *
+ * Every block also gets the temps it reads before writing them and the
+ * temps it writes, so the liveness can be solved on the blocks.
+ *
+ * @param il The instructions of a function.
+ *
+ * @return Graph whose nodes hold a fgraph_block.
+ */
 graph_graph *
-fgraph_assem_flow_graph (assem_instr_list *il,
-                        frm_frame        *f)
+fgraph_block_graph (assem_instr_list *il)
 {
-  graph_graph *g = graph_new_graph ();
-  graph_node_list *nl = NULL, *jumpnl = NULL;
-  temp_label_list *ll = NULL, *jl = NULL, *last_lbl = NULL;
-  graph_node *n = NULL, *last_n = NULL, *jump_n = NULL;
-  assem_instr *inst = NULL, *last_inst = NULL, *last_nonlbl_inst = NULL;
-
-   // Iterate and add instructions to graph
-   for (; il; il = il->tail)
-     {
-       inst = il->head;
-       if (inst->kind != I_LABEL)
-         {
-           n = graph_get_graph_node (g, (void*)inst);
-
-           if (last_inst)
-             {
-               if (last_inst->kind == I_LABEL)
-                 {
-                   nl = graph_new_node_list (n, nl);
-                   ll = temp_new_label_list (last_inst->u.label.label, ll);
-                   if (last_nonlbl_inst)
-                     {
-                       graph_add_edge (last_n, n);
-                     }
-                 }
-              else if (last_inst->kind == I_OPER
-                && last_inst->u.oper.jumps != NULL)
-                {
-                  // add edge for conditional jumps
-                  if (strstr(last_inst->u.oper.assem, "jmp")
-                    != last_inst->u.oper.assem)
-                    {
-                      graph_add_edge (last_n, n);
-                    }
-                }
-              else
-                {
-                  graph_add_edge (last_n, n);
-                }
-             }
-       if (inst->kind == I_OPER && inst->u.oper.jumps != NULL)
-         {
-           jumpnl = graph_new_node_list (n, jumpnl);
-         }
-       last_n = n;
-       last_nonlbl_inst = inst;
-      }
-      last_inst = inst;
+  graph_graph     *g      = graph_new_graph ();
+  tab_table       *labels = tab_new_table ();
+  graph_node_list *jumps  = NULL;
+  graph_node      *cur    = NULL;
+  graph_node_list *nl;
+
+  for (; il; il = il->tail)
+    {
+      assem_instr *inst = il->head;
+
+      /* Labels in a row start the same block */
+      if (inst->kind == I_LABEL
+          && (cur == NULL || fgraph_block_info (cur)->instrs != NULL))
+        cur = NULL;
+      if (cur == NULL)
+        cur = graph_get_graph_node (g, new_block ());
+
+      fgraph_block *b = fgraph_block_info (cur);
+      if (inst->kind == I_LABEL)
+        {
+          tab_bind_value (labels, inst->u.label.label, cur);
+          continue;
+        }
+
+      b->instrs = assem_new_instr_list (inst, b->instrs);
+      b->last   = inst;
+      b->use    = temp_union (b->use,
+                              temp_minus (fgraph_inst_use (inst), b->def));
+      b->def    = temp_union (b->def, fgraph_inst_def (inst));
+
+      if (fgraph_is_jump (inst))
+        {
+          jumps = graph_new_node_list (cur, jumps);
+          cur   = NULL;
+        }
+    }
+
+  for (nl = graph_nodes (g); nl; nl = nl->tail)
+    {
+      fgraph_block     *b  = fgraph_block_info (nl->head);
+      assem_instr_list *rl = NULL;
+      for (; b->instrs; b->instrs = b->instrs->tail)
+        rl = assem_new_instr_list (b->instrs->head, rl);
+      b->instrs = rl;
+      if (nl->tail != NULL
+          && (b->last == NULL || !fgraph_is_uncond_jump (b->last)))
+        graph_add_edge (nl->head, nl->tail->head);
     }
 
-   // Handle jump instructions
-   for (; jumpnl; jumpnl = jumpnl->tail)
-     {
-       n = jumpnl->head;
-       inst = (assem_instr*)graph_node_info (n);
-       for (jl = inst->u.oper.jumps->labels; jl; jl = jl->tail)
-         {
-           jump_n = find_labeled_node (jl->head, nl, ll);
-           if (jump_n)
-             {
-               graph_add_edge (n, jump_n);
-             }
-           else
-             {
-               errm_printf (0,
-                            "fail to find node for label %s",
-                            temp_label_str (jl->head));
-             }
-         }
-     }
-   return g;
- }
+  add_jump_edges (jumps, labels);
+  return g;
+}
+
+/**
+ * Calculates the static loop nesting depth of every node.
+ *
+ * An edge to a node that does not come later in the list closes a loop.
+ * All nodes between the target and the jump are inside of this loop.
+ *
+ * @param flow The flow graph of the instructions or of the blocks.
+ *
+ * @return Table from flow graph node to depth (stored as long).
+ */
+graph_table *
+fgraph_loop_depth (graph_graph *flow)
+{
+  graph_table     *index = graph_new_table ();
+  graph_table     *depth = graph_new_table ();
+  graph_node_list *nl;
+  long             count = 0;
+
+  for (nl = graph_nodes (flow); nl; nl = nl->tail)
+    graph_bind (index, nl->head, (void*)count++);
+
+  /* Loops start at delta[first] and end before delta[last + 1] */
+  long *delta = new (sizeof (long) * (count + 1));
+  memset (delta, 0, sizeof (long) * (count + 1));
+
+  for (nl = graph_nodes (flow); nl; nl = nl->tail)
+    {
+      long             from = (long)graph_lookup (index, nl->head);
+      graph_node_list *sl   = graph_succ (nl->head);
+      for (; sl; sl = sl->tail)
+        {
+          long to = (long)graph_lookup (index, sl->head);
+          if (to <= from)
+            {
+              delta[to]++;
+              delta[from + 1]--;
+            }
+        }
+    }
+
+  long d = 0;
+  count  = 0;
+  for (nl = graph_nodes (flow); nl; nl = nl->tail)
+    {
+      d += delta[count++];
+      graph_bind (depth, nl->head, (void*)d);
+    }
+  free (delta);
+
+  return depth;
+}
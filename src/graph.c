@@ -140,6 +140,32 @@ graph_rm_edge (graph_node *from,
   from->succs = delete (to, from->succs);
 }
 
+void
+graph_rm_node (graph_node *n)
+{
+  graph_graph     *g = n->mygraph;
+  graph_node_list *p, *prev = NULL;
+
+  while (n->succs != NULL)
+    graph_rm_edge (n, n->succs->head);
+  while (n->preds != NULL)
+    graph_rm_edge (n->preds->head, n);
+
+  for (p = g->mynodes; p != NULL; prev = p, p = p->tail)
+    {
+      if (p->head != n)
+        continue;
+
+      if (prev == NULL)
+        g->mynodes = p->tail;
+      else
+        prev->tail = p->tail;
+      if (g->mylast == p)
+        g->mylast = prev;
+      return;
+    }
+}
+
  /**
   * Print a human-readable dump for debugging.
   */
@@ -118,6 +118,7 @@ _absyn_var
     {
       absyn_var *var;
       absyn_exp *exp;
+      bool       in_range; /* Index can not be out of range */
     } subscript;
   } u;
 };
@@ -245,6 +246,7 @@ _absyn_dec
       sym_symbol *typ;
       absyn_exp  *init;
       bool        escape;
+      bool        local_record; /* Record can be replaced by scalars */
     } var;
 
     absyn_name_ty_list *type;
@@ -28,6 +28,7 @@ struct
 _assem_targets
 {
   temp_label_list *labels;
+  bool             uncond;  /* Never falls through to the next instruction */
 };
 
 struct
@@ -71,6 +72,8 @@ _assem_proc
 
 assem_targets *    assem_new_targets      (temp_label_list *labels);
 
+assem_targets *    assem_new_uncond_targets (temp_label_list *labels);
+
 assem_instr *      assem_new_oper        (char           *a,
                                           temp_temp_list *d,
                                           temp_temp_list *s,
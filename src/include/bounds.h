@@ -0,0 +1,20 @@
+/**
+ * @file bounds.h
+ * Searches for array subscripts that can not be out of range.
+ *
+ * A subscript a[i+k] inside of a for loop over i is in range if the loop
+ * bounds and the length of the array a got created with are known relative
+ * to the same variable and a is never assigned. These subscripts do not
+ * need a bounds check.
+ *
+ * Global functions and variables start with bnd_ .
+ */
+
+#ifndef _BOUNDS_H_
+#define _BOUNDS_H_
+
+#include "absyn.h"
+
+void bnd_find_safe_subscripts (absyn_exp *exp_ptr);
+
+#endif /* _BOUNDS_H_ */
@@ -10,6 +10,7 @@
 #include "temp.h"
 #include "graph.h"
 #include "assem.h"
+#include "table.h"
 
 
 struct
@@ -23,11 +24,15 @@ col_result
   graph_table      *alias;
 };
 
-struct col_result col_color (graph_graph      *ig,
-                             temp_map         *initial,
-                             temp_temp_list   *regs,
-                             assem_instr_list *worklistMoves,
-                             temp_map         *move_list,
-                             temp_map         *spill_cost);
+struct col_result col_color   (graph_graph      *ig,
+                               tab_table        *nodes,
+                               temp_map         *initial,
+                               temp_temp_list   *regs,
+                               assem_instr_list *worklist_moves,
+                               temp_map         *move_list,
+                               temp_map         *spill_cost);
+
+struct col_result col_recolor (assem_instr_list *moves,
+                               temp_temp_list   *removed);
 
 #endif /* _COLOR_H_ */
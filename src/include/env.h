@@ -26,8 +26,10 @@ _env_enventry
   {
     struct
     {
-      tra_access *access;
-      typ_ty     *ty;
+      tra_access      *access;
+      typ_ty          *ty;
+      tra_access_list *fields; /* Scalars of a local record, else NULL */
+      bool             local_record; /* Replaced by the scalars in fields */
     } var;
 
     struct
@@ -43,6 +45,9 @@ _env_enventry
 env_enventry* env_new_var_entry (tra_access *access_ptr,
                                  typ_ty     *typ_ptr);
 
+env_enventry* env_new_record_entry (tra_access_list *fields_ptr,
+                                    typ_ty          *typ_ptr);
+
 env_enventry* env_new_fun_entry (tra_level   *level_ptr,
                                  temp_label  *label_ptr,
                                  typ_ty_list *formals_ptr,
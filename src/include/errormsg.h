@@ -20,6 +20,10 @@ void errm_printf     (int   pos,
 void errm_impossible (char* msg_ptr,
                       ...);
 
+bool errm_line_col   (int  pos,
+                      int *line_ptr,
+                      int *col_ptr);
+
 void errm_reset      (char* filename_ptr);
 
 void errm_newline    (void);
@@ -10,15 +10,42 @@
 #include "assem.h"
 #include "temp.h"
 
-temp_temp_list * fgraph_def              (graph_node *n);
+typedef struct _fgraph_block fgraph_block;
 
-temp_temp_list * fgraph_use              (graph_node *n);
+/**
+ * A basic block of instructions, without its labels.
+ */
+struct
+_fgraph_block
+{
+  assem_instr_list *instrs;
+  assem_instr      *last;
+  temp_temp_list   *use;     /* Temps read before they get written */
+  temp_temp_list   *def;     /* Temps written */
+};
+
+temp_temp_list * fgraph_inst_def         (assem_instr *inst);
+
+temp_temp_list * fgraph_inst_use         (assem_instr *inst);
+
+void             fgraph_set_temps        (assem_instr    *inst,
+                                          temp_temp_list *use,
+                                          temp_temp_list *def);
+
+bool             fgraph_is_jump          (assem_instr *inst);
+
+bool             fgraph_is_uncond_jump   (assem_instr *inst);
+
+assem_instr *    fgraph_spill_load       (temp_temp *t,
+                                          int        offset);
+
+assem_instr *    fgraph_spill_store      (temp_temp *t,
+                                          int        offset);
 
-bool             fgraph_is_move          (graph_node *n);
+graph_graph *    fgraph_block_graph      (assem_instr_list *il);
 
-graph_graph *    fgraph_assem_flow_graph (assem_instr_list *il,
-                                          frm_frame        *f);
+fgraph_block *   fgraph_block_info       (graph_node *n);
 
-assem_instr *    fgraph_inst             (graph_node *n);
+graph_table *    fgraph_loop_depth       (graph_graph *flow);
 
 #endif /* _FGRAPH_H_ */
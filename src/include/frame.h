@@ -101,11 +101,16 @@ tree_exp *         frm_external_call    (char          *name_ptr,
 tree_stm *         frm_proc_entry_exit1 (frm_frame *frame_ptr,
                                          tree_stm  *stm_ptr);
 
-assem_instr_list * frm_proc_entry_exit2 (assem_instr_list *body);
+assem_instr_list * frm_proc_entry_exit2 (frm_frame        *frame,
+                                         assem_instr_list *body,
+                                         temp_map         *coloring);
 
 assem_proc *       frm_proc_entry_exit3 (frm_frame        *frame,
                                          assem_instr_list *body);
 
+assem_instr *      frm_tail_jump        (frm_frame  *frame_ptr,
+                                         temp_label *label_ptr);
+
 //temp_map *         frm_get_temp_map     (void);
 
 bool               frm_is_access_in_reg (frm_access *access);
@@ -53,6 +53,9 @@ void graph_add_edge (graph_node *from,
 void graph_rm_edge (graph_node *from,
                     graph_node *to);
 
+/* Delete the node "n" with all its edges from its graph */
+void graph_rm_node (graph_node *n);
+
 /* Show all the nodes and edges in the graph, using the function "showInfo"
     to print the name of each node */
 void graph_show (FILE            *out,
@@ -0,0 +1,50 @@
+/**
+ * @file inline.h
+ * Selects small leaf functions whose calls can be expanded in place.
+ *
+ * A candidate remembers the function declaration together with the
+ * bindings its free identifiers had at the point of declaration. A call
+ * site may only expand the body if all of these identifiers still resolve
+ * to the same bindings there, so the body means the same thing at the call
+ * site as in the function.
+ *
+ * Global functions and variables start with inl_ .
+ */
+
+#ifndef _INLINE_H_
+#define _INLINE_H_
+
+#include <stdbool.h>
+
+#include "absyn.h"
+#include "symbol.h"
+
+/* Maximal number of syntax tree nodes of a function body to get inlined */
+#define INL_MAX_SIZE 40
+
+typedef struct _inl_binding_list inl_binding_list;
+typedef struct _inl_candidate    inl_candidate;
+
+struct
+_inl_binding_list
+{
+  sym_table        *env;
+  sym_symbol       *sym;
+  void             *value;
+  inl_binding_list *tail;
+};
+
+struct
+_inl_candidate
+{
+  absyn_fundec     *fundec;
+  inl_binding_list *bindings;
+};
+
+inl_candidate * inl_new_candidate  (absyn_fundec *fundec_ptr,
+                                    sym_table    *venv_ptr,
+                                    sym_table    *tenv_ptr);
+
+bool            inl_scope_matches  (inl_candidate *candidate_ptr);
+
+#endif /* _INLINE_H_ */
@@ -0,0 +1,31 @@
+/**
+ * @file instrument.h
+ * Counts how often functions and basic blocks get executed.
+ *
+ * Every function gets a counter that is incremented on entry and every
+ * basic block one that is incremented behind its label. The counters and
+ * their names go into the data of the module, the runtime writes them to
+ * a profile file at exit.
+ *
+ * Global functions and variables start with ins_ .
+ */
+
+#ifndef _INSTRUMENT_H_
+#define _INSTRUMENT_H_
+
+#include <stdio.h>
+
+#include "canon.h"
+#include "symbol.h"
+#include "temp.h"
+
+void        ins_name_function (temp_label *label,
+                               sym_symbol *name,
+                               int         pos);
+
+canon_block ins_count_blocks  (temp_label  *fun,
+                               canon_block  block);
+
+void        ins_emit          (FILE *out);
+
+#endif /* _INSTRUMENT_H_ */
@@ -0,0 +1,23 @@
+/**
+ * @file linearscan.h
+ * Linear scan register allocation.
+ *
+ * Faster than the graph coloring of regalloc_do(), but every temp keeps
+ * one register from the first to the last point it is live and moves do
+ * not get coalesced. Used for huge functions and when asked for on the
+ * command line.
+ *
+ * Global functions and variables start with lsc_ .
+ */
+
+#ifndef _LINEARSCAN_H_
+#define _LINEARSCAN_H_
+
+#include "assem.h"
+#include "frame.h"
+#include "regalloc.h"
+
+struct regalloc_result lsc_allocate (frm_frame        *f,
+                                     assem_instr_list *il);
+
+#endif /* _LINEARSCAN_H_ */
@@ -8,8 +8,13 @@
 
 #include "assem.h"
 #include "graph.h"
+#include "table.h"
 #include "temp.h"
 
+/* Factor of the spill cost for each loop around an access */
+#define LIVE_LOOP_WEIGHT 10
+#define LIVE_MAX_WEIGHT  10000
+
 typedef struct _live_move_list live_move_list;
 
 struct
@@ -23,10 +28,13 @@ struct
 live_graph
 {
 	graph_graph      *graph;
+	tab_table        *nodes;     /* Temp to its node in graph */
 	live_move_list   *moves;
 	assem_instr_list *worklist_moves;
 	temp_map         *move_list;
 	temp_map         *spill_cost;
+	tab_table        *live_out;  /* Temps live after each instruction */
+	tab_table        *depth;     /* Loop depth of each instruction */
 };
 
 live_move_list *  live_new_move_list (graph_node     *src,
@@ -35,6 +43,14 @@ live_move_list *  live_new_move_list (graph_node     *src,
 
 temp_temp *       live_gtemp         (graph_node *n);
 
-struct live_graph live_liveness      (graph_graph *flow);
+struct live_graph live_liveness      (graph_graph *blocks);
+
+struct live_graph live_interference  (assem_instr_list *il,
+                                      tab_table        *live_out,
+                                      tab_table        *depth);
+
+void              live_update        (struct live_graph *lg,
+                                      temp_temp_list    *removed,
+                                      assem_instr_list  *changed);
 
 #endif /* _LIVENESS_H_ */
@@ -0,0 +1,75 @@
+/**
+ * @file passes.h
+ * Runs the phases of the back end over one function at a time.
+ *
+ * Every phase is a named pass that takes a unit, the state of one function,
+ * from one stage to the next or transforms it within a stage. The passes
+ * to run come from an optimization level or from a comma separated list of
+ * pass names. Between the passes the unit can get verified and the time of
+ * every pass gets summed up over all functions.
+ *
+ * Global functions and variables start with pas_ .
+ */
+
+#ifndef _PASSES_H_
+#define _PASSES_H_
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "assem.h"
+#include "canon.h"
+#include "frame.h"
+#include "temp.h"
+#include "tree.h"
+
+/* Optimization level without -O */
+#define PAS_DEFAULT_LEVEL 2
+
+typedef struct _pas_unit pas_unit;
+
+/**
+ * Stages of a function in the back end, the fields of a unit that are
+ * valid in a stage are noted behind it.
+ */
+typedef enum
+  {
+    PAS_TREE,       /* body */
+    PAS_STMS,       /* stms */
+    PAS_BLOCKS,     /* block */
+    PAS_ASSEM,      /* il */
+    PAS_ALLOCATED,  /* il, coloring */
+    PAS_PROC        /* proc, coloring */
+  } pas_stage;
+
+struct
+_pas_unit
+{
+  frm_frame        *frame;
+  pas_stage         stage;
+  tree_stm         *body;
+  tree_stm_list    *stms;
+  canon_block       block;
+  assem_instr_list *il;
+  temp_map         *coloring;
+  assem_proc       *proc;
+};
+
+bool       pas_set_level   (int level);
+
+bool       pas_set_passes  (char *names);
+
+void       pas_set_verify  (bool verify);
+
+void       pas_set_timing  (bool timing);
+
+void       pas_set_instrument (void);
+
+pas_unit * pas_new_unit    (frm_frame *frame,
+                            tree_stm  *body);
+
+void       pas_run         (pas_unit *unit);
+
+void       pas_print_times (FILE *out);
+
+#endif /* _PASSES_H_ */
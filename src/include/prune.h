@@ -0,0 +1,19 @@
+/**
+ * @file prune.h
+ * Removes fragments that can not be reached from the main program.
+ *
+ * Starting at tigermain, every procedure fragment gets searched for NAME
+ * references to other procedures and strings. Fragments that are never
+ * referenced do not need to be compiled.
+ *
+ * Global functions and variables start with prn_ .
+ */
+
+#ifndef _PRUNE_H_
+#define _PRUNE_H_
+
+#include "frame.h"
+
+frm_frag_list * prn_reachable_frags (frm_frag_list *frags_ptr);
+
+#endif /* _PRUNE_H_ */
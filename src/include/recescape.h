@@ -0,0 +1,20 @@
+/**
+ * @file recescape.h
+ * Searches for records that never leave the variable they are created for.
+ *
+ * A variable that gets initialized with a record expression and is only
+ * used to access fields of that record in the function it is declared in
+ * does not need the record on the heap. Its fields can be held in
+ * temporaries instead.
+ *
+ * Global functions and variables start with rec_ .
+ */
+
+#ifndef _RECESCAPE_H_
+#define _RECESCAPE_H_
+
+#include "absyn.h"
+
+void rec_find_local_records (absyn_exp *exp_ptr);
+
+#endif /* _RECESCAPE_H_ */
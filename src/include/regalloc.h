@@ -6,12 +6,17 @@
 #ifndef _REGALLOC_H_
 #define _REGALLOC_H_
 
+#include <stdbool.h>
+
 #include "assem.h"
 #include "temp.h"
 #include "frame.h"
 
 #define RA_K 6
 
+/* Functions with more instructions get the linear scan allocator */
+#define RA_LINEAR_THRESHOLD 4000
+
 struct
 regalloc_result
 {
@@ -20,6 +25,10 @@ regalloc_result
 };
 
 struct regalloc_result regalloc_do (frm_frame        *f,
-                                    assem_instr_list *il);
+                                    assem_instr_list *il,
+                                    bool              split);
+
+void                   regalloc_set_linear_scan (bool always,
+                                                 long threshold);
 
 #endif /* _REGALLOC_H_ */
@@ -0,0 +1,29 @@
+/**
+ * @file split.h
+ * Splits the live ranges of temps that would get spilled.
+ *
+ * A temp that is used inside of a loop gets a new temp for the loop, with
+ * copies where the loop is entered and left. A temp that is only live
+ * across calls gets a new temp for every call instead. The copies are moves,
+ * so the coalescing can join the pieces again where registers are left and
+ * only the cold pieces of a live range go to memory.
+ *
+ * Global functions and variables start with spl_ .
+ */
+
+#ifndef _SPLIT_H_
+#define _SPLIT_H_
+
+#include <stdbool.h>
+
+#include "assem.h"
+#include "table.h"
+#include "temp.h"
+
+bool spl_split_live_ranges (assem_instr_list **il_ptr,
+                            temp_temp_list    *temps,
+                            tab_table         *group,
+                            tab_table         *live_out,
+                            temp_temp_list   **new_temps);
+
+#endif /* _SPLIT_H_ */
@@ -48,6 +48,13 @@ _tra_access_list
 };
 
 
+void              tra_set_bounds_check (bool check);
+
+void              tra_set_heap_profile (bool profile);
+
+tra_exp *         tra_alloc_site      (tra_exp *call_ptr,
+                                       int      pos);
+
 tra_exp *         tra_simple_var      (tra_access*,
                                        tra_level*);
 
@@ -57,7 +64,8 @@ tra_exp *         tra_field_var       (tra_exp*,
 tra_exp *         tra_int_exp         (int);
 
 tra_exp *         tra_subscript_var   (tra_exp*,
-                                       tra_exp*);
+                                       tra_exp*,
+                                       bool in_range);
 
 tra_exp *         tra_arithmetic_exp  (tra_exp*,
                                        tra_exp*,
@@ -67,15 +75,21 @@ tra_exp *         tra_conditional_exp (tra_exp *,
                                        tra_exp *,
                                        TRA_OP);
 
+tra_exp *         tra_str_cond_exp    (TRA_OP,
+                                       tra_exp *,
+                                       tra_exp *);
+
 tra_exp *         tra_if_exp          (tra_exp*,
                                        tra_exp*,
                                        tra_exp*);
 
 tra_exp *         tra_array_exp       (tra_exp* size_ptr,
-                                       tra_exp* init_ptr);
+                                       tra_exp* init_ptr,
+                                       int      pos);
 
 tra_exp *         tra_record_exp      (tra_exp_list *list_ptr,
-                                       int           field_count);
+                                       int           field_count,
+                                       int           pos);
 
 tra_exp *         tra_while_exp       (tra_exp    *test_ptr,
                                        tra_exp    *body_ptr,
@@ -94,6 +108,11 @@ tra_exp *         tra_call_exp        (bool          is_lib_func,
                                        temp_label   *name,
                                        tra_exp_list *rawel);
 
+tra_exp *         tra_tail_call_exp   (tra_level    *funclv,
+                                       tra_level    *lv,
+                                       temp_label   *name,
+                                       tra_exp_list *rawel);
+
 tra_exp *         tra_for_exp         (tra_access *i,
                                        tra_level  *lv,
                                        tra_exp    *explo,
@@ -137,6 +156,10 @@ frm_frag_list *   tra_get_result      (void);
 
 frm_frag_list *   tra_get_frag_list   (void);
 
+temp_label *      tra_display_label   (void);
+
+int               tra_display_size    (void);
+
 
 tra_access_list * tra_new_access_list (tra_access *head,
                                        tra_access_list *tail);
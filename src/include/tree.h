@@ -6,6 +6,8 @@
 #ifndef _TREE_H_
 #define _TREE_H_
 
+#include <stdbool.h>
+
 //#include "list.h"
 #include "temp.h"
 
@@ -149,6 +151,7 @@ struct _tree_exp
     {
       tree_exp      *fun;
       tree_exp_list *args;
+      bool           tail; /* Reuses the frame of the caller */
     } call;
   } u;
 };
@@ -192,6 +195,9 @@ tree_exp * tree_new_const (int);
 tree_exp * tree_new_call  (tree_exp*,
                            tree_exp_list*);
 
+tree_exp * tree_new_tail_call (tree_exp*,
+                               tree_exp_list*);
+
 
 
 /* a op b    ==     not(a notRel(op) b)  */
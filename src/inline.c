@@ -0,0 +1,319 @@
+/**
+ * @file inline.c
+ * Functions to decide if a function can be expanded at its call sites.
+ *
+ * Only leaf functions are inlined: bodies that call nothing but library
+ * functions, that declare no functions or types and that stay below
+ * INL_MAX_SIZE syntax tree nodes. The body itself gets translated again at
+ * every call site by the semantic analyse, so variable accesses are resolved
+ * against the level of the caller.
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "include/util.h"
+#include "include/symbol.h"
+#include "include/absyn.h"
+#include "include/env.h"
+#include "include/translate.h"
+#include "include/inline.h"
+
+typedef struct _walk_ctx walk_ctx;
+
+/**
+ * State while walking through a function body.
+ */
+struct
+_walk_ctx
+{
+  sym_table        *venv;      /* Enviroment of the function declaration */
+  sym_table        *tenv;
+  sym_table        *bound;     /* Variables declared inside of the body */
+  int               size;      /* Number of nodes visited so far */
+  int               loop_depth;
+  bool              inlinable;
+  inl_binding_list *bindings;
+};
+
+/* Local function declarations */
+
+static void walk_exp      (walk_ctx  *ctx,
+                           absyn_exp *exp_ptr);
+
+static void walk_var      (walk_ctx  *ctx,
+                           absyn_var *var_ptr);
+
+static void walk_dec      (walk_ctx  *ctx,
+                           absyn_dec *dec_ptr);
+
+static void add_binding   (walk_ctx   *ctx,
+                           sym_table  *env_ptr,
+                           sym_symbol *sym_ptr);
+
+static void check_callee  (walk_ctx   *ctx,
+                           sym_symbol *func_ptr);
+
+/* End local function declarations */
+
+
+/**
+ * Checks if a function can be inlined and records the bindings of all free
+ * identifiers of its body.
+ *
+ * Has to be called with the enviroments of the function declaration.
+ *
+ * @param fundec_ptr The function declaration.
+ * @param venv_ptr   Variable enviroment of the declaration.
+ * @param tenv_ptr   Type enviroment of the declaration.
+ *
+ * @return New candidate or NULL if the function should not be inlined.
+ */
+inl_candidate *
+inl_new_candidate (absyn_fundec *fundec_ptr,
+                   sym_table    *venv_ptr,
+                   sym_table    *tenv_ptr)
+{
+  walk_ctx ctx;
+
+  ctx.venv       = venv_ptr;
+  ctx.tenv       = tenv_ptr;
+  ctx.bound      = sym_new_table ();
+  ctx.size       = 0;
+  ctx.loop_depth = 0;
+  ctx.inlinable  = true;
+  ctx.bindings   = NULL;
+
+  /* Parameters get new bindings at every call site */
+  absyn_field_list *params = fundec_ptr->params;
+  for (; params != NULL; params = params->tail)
+    sym_bind_symbol (ctx.bound, params->head->name, params->head);
+
+  walk_exp (&ctx, fundec_ptr->body);
+
+  if (!ctx.inlinable || ctx.size > INL_MAX_SIZE)
+    return NULL;
+
+  inl_candidate *candidate = new (sizeof (*candidate));
+  candidate->fundec   = fundec_ptr;
+  candidate->bindings = ctx.bindings;
+
+  return candidate;
+}
+
+/**
+ * Checks if the free identifiers of a candidate still resolve to the
+ * bindings they had at the function declaration.
+ *
+ * @param candidate_ptr The candidate.
+ *
+ * @return true if the body can be translated at the current position.
+ */
+bool
+inl_scope_matches (inl_candidate *candidate_ptr)
+{
+  inl_binding_list *l = candidate_ptr->bindings;
+  for (; l != NULL; l = l->tail)
+    {
+      if (sym_lookup (l->env, l->sym) != l->value)
+        return false;
+    }
+  return true;
+}
+
+static void
+walk_exp (walk_ctx  *ctx,
+          absyn_exp *exp_ptr)
+{
+  if (exp_ptr == NULL || !ctx->inlinable)
+    return;
+
+  ctx->size++;
+
+  switch (exp_ptr->kind)
+    {
+    case ABSYN_VAR_EXP:
+      walk_var (ctx, exp_ptr->u.var);
+      return;
+
+    case ABSYN_NIL_EXP:
+    case ABSYN_INT_EXP:
+    case ABSYN_STR_EXP:
+      return;
+
+    case ABSYN_CALL_EXP:
+      {
+        check_callee (ctx, exp_ptr->u.call.func);
+
+        absyn_exp_list *list = exp_ptr->u.call.args;
+        for (; list != NULL; list = list->tail)
+          walk_exp (ctx, list->head);
+        return;
+      }
+
+    case ABSYN_OP_EXP:
+      walk_exp (ctx, exp_ptr->u.op.left);
+      walk_exp (ctx, exp_ptr->u.op.right);
+      return;
+
+    case ABSYN_RECORD_EXP:
+      {
+        add_binding (ctx, ctx->tenv, exp_ptr->u.record.typ);
+
+        absyn_efield_list *list = exp_ptr->u.record.fields;
+        for (; list != NULL; list = list->tail)
+          walk_exp (ctx, list->head->exp);
+        return;
+      }
+
+    case ABSYN_SEQ_EXP:
+      {
+        absyn_exp_list *list = exp_ptr->u.seq;
+        for (; list != NULL; list = list->tail)
+          walk_exp (ctx, list->head);
+        return;
+      }
+
+    case ABSYN_ASSIGN_EXP:
+      walk_var (ctx, exp_ptr->u.assign.var);
+      walk_exp (ctx, exp_ptr->u.assign.exp);
+      return;
+
+    case ABSYN_IF_EXP:
+      walk_exp (ctx, exp_ptr->u.iff.test);
+      walk_exp (ctx, exp_ptr->u.iff.then);
+      walk_exp (ctx, exp_ptr->u.iff.elsee);
+      return;
+
+    case ABSYN_WHILE_EXP:
+      walk_exp (ctx, exp_ptr->u.whilee.test);
+      ctx->loop_depth++;
+      walk_exp (ctx, exp_ptr->u.whilee.body);
+      ctx->loop_depth--;
+      return;
+
+    case ABSYN_FOR_EXP:
+      walk_exp (ctx, exp_ptr->u.forr.lo);
+      walk_exp (ctx, exp_ptr->u.forr.hi);
+
+      sym_begin_scope (ctx->bound);
+      sym_bind_symbol (ctx->bound, exp_ptr->u.forr.var, exp_ptr);
+      ctx->loop_depth++;
+      walk_exp (ctx, exp_ptr->u.forr.body);
+      ctx->loop_depth--;
+      sym_end_scope (ctx->bound);
+      return;
+
+    case ABSYN_BREAK_EXP:
+      /* A break has to leave a loop of the body itself */
+      if (ctx->loop_depth == 0)
+        ctx->inlinable = false;
+      return;
+
+    case ABSYN_LET_EXP:
+      {
+        sym_begin_scope (ctx->bound);
+
+        absyn_dec_list *list = exp_ptr->u.let.decs;
+        for (; list != NULL; list = list->tail)
+          walk_dec (ctx, list->head);
+
+        walk_exp (ctx, exp_ptr->u.let.body);
+        sym_end_scope (ctx->bound);
+        return;
+      }
+
+    case ABSYN_ARRAY_EXP:
+      add_binding (ctx, ctx->tenv, exp_ptr->u.array.typ);
+      walk_exp (ctx, exp_ptr->u.array.size);
+      walk_exp (ctx, exp_ptr->u.array.init);
+      return;
+    }
+  assert (0);
+}
+
+static void
+walk_var (walk_ctx  *ctx,
+          absyn_var *var_ptr)
+{
+  ctx->size++;
+
+  switch (var_ptr->kind)
+    {
+    case ABSYN_SIMPLE_VAR:
+      if (sym_lookup (ctx->bound, var_ptr->u.simple) == NULL)
+        add_binding (ctx, ctx->venv, var_ptr->u.simple);
+      return;
+
+    case ABSYN_FIELD_VAR:
+      walk_var (ctx, var_ptr->u.field.var);
+      return;
+
+    case ABSYN_SUBSCRIPT_VAR:
+      walk_var (ctx, var_ptr->u.subscript.var);
+      walk_exp (ctx, var_ptr->u.subscript.exp);
+      return;
+    }
+  assert (0);
+}
+
+static void
+walk_dec (walk_ctx  *ctx,
+          absyn_dec *dec_ptr)
+{
+  switch (dec_ptr->kind)
+    {
+    case ABSYN_VAR_DEC:
+      walk_exp (ctx, dec_ptr->u.var.init);
+      if (dec_ptr->u.var.typ != NULL)
+        add_binding (ctx, ctx->tenv, dec_ptr->u.var.typ);
+      sym_bind_symbol (ctx->bound, dec_ptr->u.var.var, dec_ptr);
+      return;
+
+    case ABSYN_FUNCTION_DEC:
+    case ABSYN_TYPE_DEC:
+      /* Would need a new level or new types at every call site */
+      ctx->inlinable = false;
+      return;
+    }
+  assert (0);
+}
+
+/**
+ * Remembers the current binding of a free identifier.
+ */
+static void
+add_binding (walk_ctx   *ctx,
+             sym_table  *env_ptr,
+             sym_symbol *sym_ptr)
+{
+  inl_binding_list *l = new (sizeof (*l));
+
+  l->env   = env_ptr;
+  l->sym   = sym_ptr;
+  l->value = sym_lookup (env_ptr, sym_ptr);
+  l->tail  = ctx->bindings;
+
+  ctx->bindings = l;
+}
+
+/**
+ * Only calls to library functions are allowed in a leaf function.
+ * They have no static link and live in the outermost level.
+ */
+static void
+check_callee (walk_ctx   *ctx,
+              sym_symbol *func_ptr)
+{
+  env_enventry *entry = sym_lookup (ctx->venv, func_ptr);
+
+  if (entry == NULL
+      || entry->kind != ENV_FUN_ENTRY
+      || entry->u.fun.level != tra_outermost_level ())
+    {
+      ctx->inlinable = false;
+      return;
+    }
+  add_binding (ctx, ctx->venv, func_ptr);
+}
@@ -0,0 +1,176 @@
+/**
+ * @file instrument.c
+ * Inserts execution counters into the basic blocks of a function.
+ *
+ * Counter k is the word tigercounters + 4k, tigercountnames holds the
+ * name of every counter and tigercountsize their number. A function
+ * counter is named after the function and the position of its
+ * declaration, a block counter additionally by the label of the block.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "include/errormsg.h"
+#include "include/frame.h"
+#include "include/table.h"
+#include "include/util.h"
+#include "include/instrument.h"
+
+typedef struct _ins_name ins_name;
+
+struct
+_ins_name
+{
+  char     *name;
+  ins_name *next;
+};
+
+static tab_table *functions = NULL; /* Label to name of the functions */
+static ins_name  *names     = NULL; /* Names of the counters, last first */
+static int        count     = 0;
+
+/* Local function declarations */
+
+static tree_stm * new_counter   (char *name);
+
+static char *     function_name (temp_label *fun);
+
+/* End local function declarations */
+
+/**
+ * Remembers the name and position of a function, so its counters can
+ * be found in the profile.
+ *
+ * @param label Label of the function.
+ * @param name  Name of the function.
+ * @param pos   Position of the declaration.
+ */
+void
+ins_name_function (temp_label *label,
+                   sym_symbol *name,
+                   int         pos)
+{
+  char buf[256];
+  int  line, col;
+
+  if (functions == NULL)
+    functions = tab_new_table ();
+
+  if (errm_line_col (pos, &line, &col))
+    snprintf (buf, sizeof (buf), "%s %d.%d", sym_name (name), line, col);
+  else
+    snprintf (buf, sizeof (buf), "%s", sym_name (name));
+  tab_bind_value (functions, label, string_new (buf));
+}
+
+/**
+ * Adds a counter behind the label of every block and a new first block
+ * that counts the calls of the function.
+ *
+ * @param fun   Label of the function.
+ * @param block Basic blocks of the function.
+ *
+ * @return The blocks with counters.
+ */
+canon_block
+ins_count_blocks (temp_label  *fun,
+                  canon_block  block)
+{
+  char               *name  = function_name (fun);
+  tree_stm           *calls = new_counter (name);
+  char                buf[512];
+  canon_stmlist_list *l;
+
+  for (l = block.stm_lists; l != NULL; l = l->tail)
+    {
+      tree_stm_list *label = l->head;
+      snprintf (buf, sizeof (buf), "%s %s", name,
+                temp_label_str (label->head->u.label));
+      label->tail = tree_new_stm_list (new_counter (buf), label->tail);
+    }
+
+  /* Entry block, the first block may also be the target of jumps */
+  temp_label *entry = temp_new_label ();
+  temp_label *first = block.stm_lists != NULL
+    ? block.stm_lists->head->head->u.label
+    : block.label;
+  tree_stm_list *stms =
+    tree_new_stm_list (
+      tree_new_label (entry),
+      tree_new_stm_list (
+        calls,
+        tree_new_stm_list (
+          tree_new_jump (tree_new_name (first),
+                         temp_new_label_list (first, NULL)),
+          NULL)));
+
+  block.stm_lists = canon_new_stmlist_list (stms, block.stm_lists);
+  return block;
+}
+
+/**
+ * Writes the counters and their names to the data of the module.
+ *
+ * @param out File to write to.
+ */
+void
+ins_emit (FILE *out)
+{
+  ins_name *n;
+  ins_name *ordered = NULL;
+  int       i;
+
+  if (count == 0)
+    return;
+
+  for (n = names; n != NULL; n = names)
+    {
+      names   = n->next;
+      n->next = ordered;
+      ordered = n;
+    }
+
+  fprintf (out, ".align %d\n", frm_word_size);
+  fprintf (out, ".globl tigercounters\n");
+  fprintf (out, ".globl tigercountnames\n");
+  fprintf (out, ".globl tigercountsize\n");
+  fprintf (out, "tigercountsize:\n    .long %d\n", count);
+  fprintf (out, "tigercounters:\n    .fill %d, %d, 0\n", count, frm_word_size);
+  fprintf (out, "tigercountnames:\n");
+  for (i = 0, n = ordered; n != NULL; n = n->next, i++)
+    fprintf (out, "    .long tigercountname%d\n", i);
+  for (i = 0, n = ordered; n != NULL; n = n->next, i++)
+    fprintf (out, "tigercountname%d:\n    .asciz \"%s\"\n", i, n->name);
+  fprintf (out, "\n");
+}
+
+/* MEM(tigercounters + 4k) := MEM(tigercounters + 4k) + 1 for a new k */
+static tree_stm *
+new_counter (char *name)
+{
+  ins_name *n = new (sizeof (*n));
+  n->name = string_new (name);
+  n->next = names;
+  names   = n;
+
+  temp_label *counters = temp_named_label ("tigercounters");
+  int         offset   = count++ * frm_word_size;
+  tree_exp   *dst      = tree_new_mem (
+    tree_new_bin_op (TREE_PLUS, tree_new_name (counters),
+                     tree_new_const (offset)));
+  tree_exp   *src      = tree_new_mem (
+    tree_new_bin_op (TREE_PLUS, tree_new_name (counters),
+                     tree_new_const (offset)));
+
+  return tree_new_move (dst,
+                        tree_new_bin_op (TREE_PLUS, src, tree_new_const (1)));
+}
+
+static char *
+function_name (temp_label *fun)
+{
+  char *name = functions ? tab_lookup (functions, fun) : NULL;
+  return name ? name : temp_label_str (fun);
+}
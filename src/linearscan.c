@@ -0,0 +1,671 @@
+/**
+ * @file linearscan.c
+ * Linear scan register allocation over live intervals.
+ *
+ * Every instruction i has two points, 2i where it reads its operands and
+ * 2i + 1 where it writes its results. The liveness is solved once per
+ * basic block with bit sets, the interval of a temp reaches from the first
+ * to the last point it is live at. Registers used by precolored temps are
+ * only blocked where these temps are live, like around calls.
+ *
+ * The intervals get visited by their start. If no register is free, the
+ * interval that ends last gets spilled. The spilled temps are rewritten
+ * like in regalloc_do() and the allocation starts again.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "include/util.h"
+#include "include/errormsg.h"
+#include "include/table.h"
+#include "include/temp.h"
+#include "include/assem.h"
+#include "include/frame.h"
+#include "include/graph.h"
+#include "include/flowgraph.h"
+#include "include/regalloc.h"
+#include "include/linearscan.h"
+
+#define WORD_BITS (8 * sizeof (unsigned long))
+
+typedef struct _interval interval;
+typedef struct _range    range;
+typedef struct _scan_ctx scan_ctx;
+
+struct
+_interval
+{
+  temp_temp *temp;
+  long       id;
+  long       start, end;
+};
+
+/**
+ * Points a precolored register is live in.
+ */
+struct
+_range
+{
+  long start, end;
+};
+
+struct
+_scan_ctx
+{
+  assem_instr   **insts;
+  long            count;
+  tab_table      *labels;    /* Label to its index + 1 */
+  tab_table      *ids;       /* Temp to its number + 1 */
+  temp_temp     **temps;
+  long            ntemps;
+  long            words;     /* Size of a bit set */
+  long           *start;     /* Interval of every temp, -1 if never live */
+  long           *end;
+  temp_temp     **regs;      /* The allocatable registers */
+  int             nregs;
+  range         **fixed;     /* Ranges of every register, sorted */
+  long           *nfixed;
+  long           *cap;
+};
+
+/* Local function declarations */
+
+static void number_temps   (scan_ctx         *ctx,
+                            assem_instr_list *il);
+
+static void find_intervals (scan_ctx *ctx);
+
+static temp_temp_list *
+            scan           (scan_ctx  *ctx,
+                            temp_map  *initial,
+                            tab_table *spill_temps,
+                            temp_map  *coloring);
+
+static assem_instr_list *
+            rewrite        (frm_frame        *f,
+                            assem_instr_list *il,
+                            temp_temp_list   *spilled,
+                            tab_table        *spill_temps);
+
+/* End local function declarations */
+
+
+/**
+ * Allocates registers for the temps of a function.
+ *
+ * @param f  The frame of the function, gets the spilled temps.
+ * @param il The instructions of the function.
+ *
+ * @return The coloring and the rewritten instructions.
+ */
+struct regalloc_result
+lsc_allocate (frm_frame        *f,
+              assem_instr_list *il)
+{
+  struct regalloc_result ret;
+  temp_map              *initial     = frm_initial_registers (f);
+  tab_table             *spill_temps = tab_new_table ();
+  temp_map              *coloring;
+
+  while (true)
+    {
+      scan_ctx ctx;
+
+      coloring = temp_layer_map (temp_new_map (), initial);
+      number_temps (&ctx, il);
+      find_intervals (&ctx);
+
+      temp_temp_list *spilled = scan (&ctx, initial, spill_temps, coloring);
+      if (spilled == NULL)
+        break;
+
+      il = rewrite (f, il, spilled, spill_temps);
+    }
+
+  /* Moves inside of one register are not needed */
+  assem_instr_list *l;
+  for (l = il; l; l = l->tail)
+    {
+      assem_instr *inst = l->head;
+      if (inst->kind != I_MOVE || inst->u.move.dst == NULL
+          || inst->u.move.src == NULL)
+        continue;
+
+      char *dst = temp_lookup (coloring, inst->u.move.dst->head);
+      char *src = temp_lookup (coloring, inst->u.move.src->head);
+      if (dst != NULL && src != NULL && strcmp (dst, src) == 0)
+        {
+          char buf[1024];
+          sprintf (buf, "# %s", inst->u.move.assem);
+          inst->u.move.assem = string_new (buf);
+        }
+    }
+
+  ret.coloring = coloring;
+  ret.il       = il;
+  return ret;
+}
+
+static long
+temp_id (scan_ctx  *ctx,
+         temp_temp *t)
+{
+  return (long)tab_lookup (ctx->ids, t) - 1;
+}
+
+static void
+add_temps (scan_ctx       *ctx,
+           temp_temp_list *tl,
+           long           *capacity)
+{
+  for (; tl; tl = tl->tail)
+    {
+      if (temp_id (ctx, tl->head) >= 0)
+        continue;
+
+      if (ctx->ntemps == *capacity)
+        {
+          temp_temp **temps = new (sizeof (temp_temp*) * *capacity * 2);
+          memcpy (temps, ctx->temps, sizeof (temp_temp*) * *capacity);
+          ctx->temps = temps;
+          *capacity *= 2;
+        }
+      ctx->temps[ctx->ntemps++] = tl->head;
+      tab_bind_value (ctx->ids, tl->head, (void*)ctx->ntemps);
+    }
+}
+
+/**
+ * Numbers the instructions and the temps of a function.
+ */
+static void
+number_temps (scan_ctx         *ctx,
+              assem_instr_list *il)
+{
+  assem_instr_list *l;
+  long              i, capacity = 64;
+
+  ctx->count = 0;
+  for (l = il; l; l = l->tail)
+    ctx->count++;
+
+  ctx->insts  = new (sizeof (assem_instr*) * (ctx->count + 1));
+  ctx->labels = tab_new_table ();
+  ctx->ids    = tab_new_table ();
+  ctx->temps  = new (sizeof (temp_temp*) * capacity);
+  ctx->ntemps = 0;
+
+  for (i = 0, l = il; l; l = l->tail, i++)
+    {
+      ctx->insts[i] = l->head;
+      if (l->head->kind == I_LABEL)
+        tab_bind_value (ctx->labels, l->head->u.label.label, (void*)(i + 1));
+      add_temps (ctx, fgraph_inst_use (l->head), &capacity);
+      add_temps (ctx, fgraph_inst_def (l->head), &capacity);
+    }
+
+  temp_temp_list *regs = frm_registers ();
+  ctx->nregs = 0;
+  for (; regs; regs = regs->tail)
+    ctx->nregs++;
+
+  ctx->regs   = new (sizeof (temp_temp*) * ctx->nregs);
+  ctx->fixed  = new (sizeof (range*) * ctx->nregs);
+  ctx->nfixed = new (sizeof (long) * ctx->nregs);
+  ctx->cap    = new (sizeof (long) * ctx->nregs);
+  for (i = 0, regs = frm_registers (); regs; regs = regs->tail, i++)
+    {
+      ctx->regs[i]   = regs->head;
+      ctx->cap[i]    = 16;
+      ctx->fixed[i]  = new (sizeof (range) * ctx->cap[i]);
+      ctx->nfixed[i] = 0;
+    }
+}
+
+static void
+set_bits (scan_ctx       *ctx,
+          unsigned long  *set,
+          temp_temp_list *tl)
+{
+  for (; tl; tl = tl->tail)
+    {
+      long id = temp_id (ctx, tl->head);
+      set[id / WORD_BITS] |= 1UL << (id % WORD_BITS);
+    }
+}
+
+static bool
+test_bit (unsigned long *set,
+          long           id)
+{
+  return (set[id / WORD_BITS] >> (id % WORD_BITS)) & 1;
+}
+
+static void
+extend (scan_ctx *ctx,
+        long      id,
+        long      point)
+{
+  if (ctx->start[id] < 0 || point < ctx->start[id])
+    ctx->start[id] = point;
+  if (point > ctx->end[id])
+    ctx->end[id] = point;
+}
+
+static void
+extend_list (scan_ctx       *ctx,
+             temp_temp_list *tl,
+             long            point)
+{
+  for (; tl; tl = tl->tail)
+    extend (ctx, temp_id (ctx, tl->head), point);
+}
+
+static void
+extend_set (scan_ctx      *ctx,
+            unsigned long *set,
+            long           point)
+{
+  unsigned long bit;
+  long          k;
+  for (k = 0; k < ctx->words; k++)
+    {
+      for (bit = 0; bit < WORD_BITS && set[k] >> bit != 0; bit++)
+        {
+          if ((set[k] >> bit) & 1)
+            extend (ctx, k * WORD_BITS + bit, point);
+        }
+    }
+}
+
+static void
+add_range (scan_ctx *ctx,
+           int       r,
+           long      start,
+           long      end)
+{
+  if (ctx->nfixed[r] == ctx->cap[r])
+    {
+      range *ranges = new (sizeof (range) * ctx->cap[r] * 2);
+      memcpy (ranges, ctx->fixed[r], sizeof (range) * ctx->cap[r]);
+      ctx->fixed[r] = ranges;
+      ctx->cap[r] *= 2;
+    }
+  ctx->fixed[r][ctx->nfixed[r]].start = start;
+  ctx->fixed[r][ctx->nfixed[r]].end   = end;
+  ctx->nfixed[r]++;
+}
+
+static int
+compare_ranges (const void *a,
+                const void *b)
+{
+  long sa = ((range*)a)->start, sb = ((range*)b)->start;
+  return sa < sb ? -1 : sa > sb;
+}
+
+/**
+ * Walks backwards through a block and records where the register r is
+ * live. A definition that is never used still blocks its own point.
+ */
+static void
+find_fixed (scan_ctx      *ctx,
+            int            r,
+            long           first,
+            long           last,
+            unsigned long *out)
+{
+  long id   = temp_id (ctx, ctx->regs[r]);
+  bool live = test_bit (out, id);
+  long open = 2 * last + 1;
+  long i;
+
+  for (i = last; i >= first; i--)
+    {
+      assem_instr *inst = ctx->insts[i];
+      if (temp_in_list (ctx->regs[r], fgraph_inst_def (inst)))
+        {
+          add_range (ctx, r, 2 * i + 1, live ? open : 2 * i + 1);
+          live = false;
+        }
+      if (temp_in_list (ctx->regs[r], fgraph_inst_use (inst)) && !live)
+        {
+          open = 2 * i;
+          live = true;
+        }
+    }
+  if (live)
+    add_range (ctx, r, 2 * first, open);
+}
+
+/**
+ * Solves the dataflow equations on the basic blocks and builds the
+ * intervals of all temps and the ranges of the registers.
+ */
+static void
+find_intervals (scan_ctx *ctx)
+{
+  long n = ctx->count, w = (ctx->ntemps + WORD_BITS - 1) / WORD_BITS;
+  long i, b, k, nb = 0;
+
+  ctx->words = w;
+
+  /* Blocks start at labels and behind jumps */
+  long *first    = new (sizeof (long) * (n + 1));
+  long *last     = new (sizeof (long) * (n + 1));
+  long *block_of = new (sizeof (long) * (n + 1));
+  for (i = 0; i < n; i++)
+    {
+      if (i == 0 || ctx->insts[i]->kind == I_LABEL
+          || fgraph_is_jump (ctx->insts[i - 1]))
+        first[nb++] = i;
+      block_of[i]  = nb - 1;
+      last[nb - 1] = i;
+    }
+
+  size_t         size = sizeof (unsigned long) * (nb * w + 1);
+  unsigned long *use  = new (size), *def = new (size);
+  unsigned long *in   = new (size), *out = new (size);
+  unsigned long *tmp  = new (sizeof (unsigned long) * (w + 1));
+  memset (use, 0, size);
+  memset (def, 0, size);
+  memset (in, 0, size);
+  memset (out, 0, size);
+
+  for (b = 0; b < nb; b++)
+    {
+      for (i = first[b]; i <= last[b]; i++)
+        {
+          temp_temp_list *tl = fgraph_inst_use (ctx->insts[i]);
+          for (; tl; tl = tl->tail)
+            {
+              long id = temp_id (ctx, tl->head);
+              if (!test_bit (def + b * w, id))
+                use[b * w + id / WORD_BITS] |= 1UL << (id % WORD_BITS);
+            }
+          set_bits (ctx, def + b * w, fgraph_inst_def (ctx->insts[i]));
+        }
+    }
+
+  bool changed = true;
+  while (changed)
+    {
+      changed = false;
+      for (b = nb - 1; b >= 0; b--)
+        {
+          unsigned long *o    = out + b * w;
+          assem_instr   *jump = ctx->insts[last[b]];
+
+          memset (o, 0, sizeof (unsigned long) * w);
+          if (fgraph_is_jump (jump))
+            {
+              temp_label_list *ll = jump->u.oper.jumps->labels;
+              for (; ll; ll = ll->tail)
+                {
+                  long h = (long)tab_lookup (ctx->labels, ll->head) - 1;
+                  if (h < 0)
+                    continue;
+                  for (k = 0; k < w; k++)
+                    o[k] |= in[block_of[h] * w + k];
+                }
+            }
+          if (!fgraph_is_uncond_jump (jump) && b + 1 < nb)
+            {
+              for (k = 0; k < w; k++)
+                o[k] |= in[(b + 1) * w + k];
+            }
+
+          for (k = 0; k < w; k++)
+            tmp[k] = use[b * w + k] | (o[k] & ~def[b * w + k]);
+          if (memcmp (tmp, in + b * w, sizeof (unsigned long) * w) != 0)
+            {
+              memcpy (in + b * w, tmp, sizeof (unsigned long) * w);
+              changed = true;
+            }
+        }
+    }
+
+  ctx->start = new (sizeof (long) * (ctx->ntemps + 1));
+  ctx->end   = new (sizeof (long) * (ctx->ntemps + 1));
+  for (k = 0; k < ctx->ntemps; k++)
+    ctx->start[k] = ctx->end[k] = -1;
+
+  for (b = 0; b < nb; b++)
+    {
+      extend_set (ctx, in + b * w, 2 * first[b]);
+      extend_set (ctx, out + b * w, 2 * last[b] + 1);
+      for (i = first[b]; i <= last[b]; i++)
+        {
+          extend_list (ctx, fgraph_inst_use (ctx->insts[i]), 2 * i);
+          extend_list (ctx, fgraph_inst_def (ctx->insts[i]), 2 * i + 1);
+        }
+
+      int r;
+      for (r = 0; r < ctx->nregs; r++)
+        {
+          if (temp_id (ctx, ctx->regs[r]) >= 0)
+            find_fixed (ctx, r, first[b], last[b], out + b * w);
+        }
+    }
+
+  int r;
+  for (r = 0; r < ctx->nregs; r++)
+    qsort (ctx->fixed[r], ctx->nfixed[r], sizeof (range), compare_ranges);
+}
+
+/**
+ * Checks if the register r is used by a precolored temp between the
+ * points start and end.
+ */
+static bool
+fixed_conflict (scan_ctx *ctx,
+                int       r,
+                long      start,
+                long      end)
+{
+  range *ranges = ctx->fixed[r];
+  long   lo = 0, hi = ctx->nfixed[r];
+
+  /* First range that ends at start or later, the ranges do not overlap */
+  while (lo < hi)
+    {
+      long mid = (lo + hi) / 2;
+      if (ranges[mid].end < start)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  return lo < ctx->nfixed[r] && ranges[lo].start <= end;
+}
+
+static int
+compare_intervals (const void *a,
+                   const void *b)
+{
+  const interval *ia = a, *ib = b;
+  if (ia->start != ib->start)
+    return ia->start < ib->start ? -1 : 1;
+  return ia->id < ib->id ? -1 : ia->id > ib->id;
+}
+
+/**
+ * Assigns registers to the intervals in the order of their start.
+ *
+ * @return The temps that have to be spilled or NULL.
+ */
+static temp_temp_list *
+scan (scan_ctx  *ctx,
+      temp_map  *initial,
+      tab_table *spill_temps,
+      temp_map  *coloring)
+{
+  interval       *iv      = new (sizeof (interval) * (ctx->ntemps + 1));
+  interval      **owner   = new (sizeof (interval*) * ctx->nregs);
+  temp_temp_list *spilled = NULL;
+  long            n = 0, k;
+  int             r;
+
+  for (k = 0; k < ctx->ntemps; k++)
+    {
+      if (ctx->start[k] < 0 || temp_lookup (initial, ctx->temps[k]) != NULL)
+        continue;
+      iv[n].temp  = ctx->temps[k];
+      iv[n].id    = k;
+      iv[n].start = ctx->start[k];
+      iv[n].end   = ctx->end[k];
+      n++;
+    }
+  qsort (iv, n, sizeof (interval), compare_intervals);
+
+  for (r = 0; r < ctx->nregs; r++)
+    owner[r] = NULL;
+
+  for (k = 0; k < n; k++)
+    {
+      interval *cur  = &iv[k];
+      bool      tiny = tab_lookup (spill_temps, cur->temp) != NULL;
+      int       reg  = -1, victim = -1;
+
+      for (r = 0; r < ctx->nregs; r++)
+        {
+          if (owner[r] != NULL && owner[r]->end < cur->start)
+            owner[r] = NULL;
+        }
+
+      for (r = 0; r < ctx->nregs && reg == -1; r++)
+        {
+          if (owner[r] == NULL
+              && !fixed_conflict (ctx, r, cur->start, cur->end))
+            reg = r;
+        }
+
+      if (reg == -1)
+        {
+          /* Spill the interval that ends last, never one of a spill */
+          for (r = 0; r < ctx->nregs; r++)
+            {
+              if (owner[r] == NULL
+                  || tab_lookup (spill_temps, owner[r]->temp) != NULL
+                  || fixed_conflict (ctx, r, cur->start, cur->end))
+                continue;
+              if (victim == -1 || owner[r]->end > owner[victim]->end)
+                victim = r;
+            }
+
+          if (victim != -1 && (tiny || owner[victim]->end > cur->end))
+            {
+              spilled = temp_new_temp_list (owner[victim]->temp, spilled);
+              reg = victim;
+            }
+          else if (!tiny)
+            {
+              spilled = temp_new_temp_list (cur->temp, spilled);
+              continue;
+            }
+          else
+            {
+              /* Every register is held by a temp of a spill or a
+                 precolored temp, spilling cannot make progress */
+              errm_impossible ("fail to allocate registers");
+            }
+        }
+
+      owner[reg] = cur;
+      temp_bind_temp (coloring, cur->temp,
+                      temp_lookup (initial, ctx->regs[reg]));
+    }
+  return spilled;
+}
+
+static temp_temp_list *
+replace_temps (temp_temp_list *tl,
+               temp_temp_list *spilled,
+               tab_table      *fresh,
+               tab_table      *spill_temps)
+{
+  temp_temp_list *rl = NULL;
+  for (; tl; tl = tl->tail)
+    {
+      temp_temp *t = tl->head;
+      if (temp_in_list (t, spilled))
+        {
+          temp_temp *nt = tab_lookup (fresh, t);
+          if (nt == NULL)
+            {
+              nt = temp_new_temp ();
+              tab_bind_value (fresh, t, nt);
+              tab_bind_value (spill_temps, nt, nt);
+            }
+          t = nt;
+        }
+      rl = temp_new_temp_list (t, rl);
+    }
+  return temp_reverse_list (rl);
+}
+
+/**
+ * Gives every spilled temp a slot in the frame. Each instruction gets a
+ * new temp for it, loaded in front of it and stored behind it.
+ */
+static assem_instr_list *
+rewrite (frm_frame        *f,
+         assem_instr_list *il,
+         temp_temp_list   *spilled,
+         tab_table        *spill_temps)
+{
+  tab_table        *locals = tab_new_table ();
+  assem_instr_list *rl     = NULL;
+  temp_temp_list   *tl;
+
+  for (tl = spilled; tl; tl = tl->tail)
+    tab_bind_value (locals, tl->head, frm_alloc_local (f, true));
+
+  for (; il; il = il->tail)
+    {
+      assem_instr    *inst = il->head;
+      temp_temp_list *use  = temp_intersect (fgraph_inst_use (inst), spilled);
+      temp_temp_list *def  = temp_intersect (fgraph_inst_def (inst), spilled);
+
+      if (use == NULL && def == NULL)
+        {
+          rl = assem_new_instr_list (inst, rl);
+          continue;
+        }
+
+      tab_table      *fresh = tab_new_table ();
+      temp_temp_list *src   = replace_temps (fgraph_inst_use (inst), spilled,
+                                             fresh, spill_temps);
+      temp_temp_list *dst   = replace_temps (fgraph_inst_def (inst), spilled,
+                                             fresh, spill_temps);
+
+      for (tl = use; tl; tl = tl->tail)
+        {
+          frm_access *local = tab_lookup (locals, tl->head);
+          rl = assem_new_instr_list (
+                 fgraph_spill_load (tab_lookup (fresh, tl->head),
+                                    frm_access_offset (local)),
+                 rl);
+        }
+
+      fgraph_set_temps (inst, src, dst);
+      rl = assem_new_instr_list (inst, rl);
+
+      for (tl = def; tl; tl = tl->tail)
+        {
+          frm_access *local = tab_lookup (locals, tl->head);
+          rl = assem_new_instr_list (
+                 fgraph_spill_store (tab_lookup (fresh, tl->head),
+                                     frm_access_offset (local)),
+                 rl);
+        }
+    }
+
+  /* The list was built in reverse */
+  assem_instr_list *ol = NULL;
+  for (; rl; rl = rl->tail)
+    ol = assem_new_instr_list (rl->head, ol);
+  return ol;
+}
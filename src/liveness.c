@@ -99,55 +99,40 @@ lookup_live_map (graph_table *t,
   return (temp_temp_list*)graph_lookup (t, flownode);
 }
 
+/**
+ * Solves the dataflow equations on the basic blocks, with the use and def
+ * summaries of every block.
+ */
 static void
-get_live_map (graph_graph *flow,
+get_live_map (graph_graph *blocks,
               graph_table *in,
               graph_table *out)
 {
   graph_node_list *fl, *sl;
-  graph_node *n, *sn;
-	graph_table *last_in = graph_new_table ();
-  graph_table *last_out = graph_new_table ();
-  temp_temp_list *ci, *co, *li, *lo;
-  bool flag = true;
-
-	// Loop
-	while (flag)
+  temp_temp_list *ci, *co;
+  bool changed = true;
+  /* Liveness flows backwards, visit the last block first */
+  graph_node_list *rnodes = graph_reverse_nodes (graph_nodes (blocks));
+
+  while (changed)
     {
-      for (fl = graph_nodes (flow); fl; fl = fl->tail)
+      changed = false;
+      for (fl = rnodes; fl; fl = fl->tail)
         {
-		      n = fl->head;
-          li = lookup_live_map (in, n);
-          lo = lookup_live_map (out, n);
-          enter_live_map (last_in, n, li);
-          enter_live_map (last_out, n, lo);
+          graph_node   *n = fl->head;
+          fgraph_block *b = fgraph_block_info (n);
 
-          ci = union_temp (fgraph_use (n), minus_temp (lo, fgraph_def (n)));
           co = NULL;
           for (sl = graph_succ (n); sl; sl = sl->tail)
-            {
-              sn = sl->head;
-              co = union_temp (co, lookup_live_map (in, sn));
-            }
+            co = union_temp (co, lookup_live_map (in, sl->head));
+          ci = union_temp (b->use, minus_temp (co, b->def));
+
+          if (!equal_temp (ci, lookup_live_map (in, n)))
+            changed = true;
           enter_live_map (in, n, ci);
           enter_live_map (out, n, co);
-	      }
-      flag = false;
-      for (fl = graph_nodes (flow); fl; fl = fl->tail)
-        {
-          n = fl->head;
-          li = lookup_live_map (in, n);
-          lo = lookup_live_map (out, n);
-          ci = lookup_live_map (last_in, n);
-          co = lookup_live_map (last_out, n);
-
-          if (!equal_temp (li, ci) || !equal_temp (lo, co))
-            {
-              flag = true;
-              break;
-            }
         }
-	  }
+    }
 }
 
 static graph_node *
@@ -164,98 +149,193 @@ find_or_create_node (temp_temp   *t,
   return ln;
 }
 
+/**
+ * Adds the nodes of the temps of an instruction and the edges of its
+ * definitions to the interference graph. A move also goes into the move
+ * lists of its temps.
+ */
 static void
-solve_liveness (struct live_graph *lg,
-                graph_graph       *flow,
-                graph_table       *in,
-                graph_table       *out)
+add_instr (struct live_graph *lg,
+           assem_instr       *inst)
 {
-  graph_graph *g = graph_new_graph ();
-  tab_table *tab = tab_new_table ();
-  live_move_list *ml = NULL;
-  graph_node_list *fl;
-  graph_node *n, *ndef, *nedge, *move_src, *move_dst;
-  temp_temp_list *tdef, *tout, *tuse, *t, *tedge;
+  graph_graph    *g    = lg->graph;
+  tab_table      *tab  = lg->nodes;
+  temp_temp_list *tout = (temp_temp_list*)tab_lookup (lg->live_out, inst);
+  temp_temp_list *tdef = fgraph_inst_def (inst);
+  temp_temp_list *tuse = fgraph_inst_use (inst);
+  temp_temp_list *t, *tedge;
+  graph_node     *ndef, *nedge;
 
-  temp_map *move_list = temp_new_map ();
-  temp_map *spill_cost = temp_new_map ();
-  assem_instr *inst;
-  assem_instr_list *worklist_moves = NULL;
+  // Move instruction?
+  if (inst->kind == I_MOVE)
+    {
+      for (t = union_temp (tuse, tdef); t; t = t->tail)
+        {
+          find_or_create_node (t->head, g, tab);
+          assem_instr_list *ml =
+            (assem_instr_list*)temp_look_ptr (lg->move_list, t->head);
+          ml = inst_union (ml, assem_new_instr_list (inst, NULL));
+          temp_enter_ptr (lg->move_list, t->head, (void*)ml);
+        }
+      lg->worklist_moves = inst_union (lg->worklist_moves,
+                                       assem_new_instr_list (inst, NULL));
+    }
 
-  // Traverse node
-  for (fl = graph_nodes (flow); fl; fl = fl->tail)
+  // Every defined var interferes with the vars live after the
+  // instruction. This also holds for dead definitions, like the caller
+  // saves that get clobbered by a call.
+  for (t = tdef; t; t = t->tail)
     {
-      n = fl->head;
-      inst = fgraph_inst (n);
-      tout = lookup_live_map (out, n);
-      tdef = fgraph_def (n);
-      tuse = fgraph_use (n);
+      ndef = find_or_create_node (t->head, g, tab);
+      for (tedge = tout; tedge; tedge = tedge->tail)
+        {
+          nedge = find_or_create_node (tedge->head, g, tab);
+          // Skip if edge is added
+          if (ndef == nedge
+              || graph_goes_to (ndef, nedge)
+              || graph_goes_to (nedge, ndef))
+            {
+              continue;
+            }
+          // Skip src for move instruction
+          if (inst->kind == I_MOVE && temp_in_list (tedge->head, tuse))
+            {
+              continue;
+            }
+          graph_add_edge (ndef, nedge);
+        }
+    }
+  for (t = tuse; t; t = t->tail)
+    find_or_create_node (t->head, g, tab);
+}
 
-    temp_temp_list *defuse = union_temp (tuse, tdef);
+/**
+ * Builds the interference graph, the move lists and the spill costs from
+ * the temps live after every instruction.
+ *
+ * @param il       The instructions.
+ * @param live_out Table from instruction to the temps live after it.
+ * @param depth    Table from instruction to its loop depth (long).
+ *
+ * @return The interference graph.
+ */
+struct live_graph
+live_interference (assem_instr_list *il,
+                   tab_table        *live_out,
+                   tab_table        *depth)
+{
+  struct live_graph lg;
+  temp_temp_list *t;
 
-    // Spill Cost
-    for (t = defuse; t; t = t->tail)
+  lg.graph          = graph_new_graph ();
+  lg.nodes          = tab_new_table ();
+  lg.worklist_moves = NULL;
+  lg.move_list      = temp_new_map ();
+  lg.spill_cost     = temp_new_map ();
+  lg.live_out       = live_out;
+  lg.depth          = depth;
+
+  // Traverse instructions
+  for (; il; il = il->tail)
+    {
+      assem_instr *inst = il->head;
+      if (inst->kind == I_LABEL)
+        continue;
+
+    // Spill Cost, an access inside of a loop counts
+    // LIVE_LOOP_WEIGHT times more than one outside of it
+    long weight = 1;
+    long d = (long)tab_lookup (depth, inst);
+    for (; d > 0 && weight < LIVE_MAX_WEIGHT; d--)
+      weight *= LIVE_LOOP_WEIGHT;
+
+    for (t = union_temp (fgraph_inst_use (inst), fgraph_inst_def (inst));
+         t; t = t->tail)
       {
         temp_temp *ti = t->head;
-        long spills = (long)temp_look_ptr(spill_cost, ti);
-        spills++;
-        temp_enter_ptr (spill_cost, ti, (void*)spills);
+        long spills = (long)temp_look_ptr (lg.spill_cost, ti);
+        spills += weight;
+        temp_enter_ptr (lg.spill_cost, ti, (void*)spills);
       }
 
-    // Move instruction?
-    if (fgraph_is_move (n))
-      {
-        for (; defuse; defuse = defuse->tail)
-          {
-            temp_temp *t = defuse->head;
-            find_or_create_node (t, g, tab);
-            assem_instr_list *ml =
-              (assem_instr_list*)temp_look_ptr (move_list, t);
-            ml = inst_union (ml, assem_new_instr_list (inst, NULL));
-            temp_enter_ptr (move_list, t, (void*)ml);
-          }
-        worklist_moves = inst_union (worklist_moves,
-                                     assem_new_instr_list (inst, NULL));
-      }
+    add_instr (&lg, inst);
+  }
 
-    // Traverse defined vars
-    for (t = tout; t; t = t->tail)
-      {
-        ndef = find_or_create_node (t->head, g, tab);
-        // Add edges between output vars and defined var
-        for (tedge = tout; tedge; tedge = tedge->tail)
-          {
-            nedge = find_or_create_node (tedge->head, g, tab);
-            // Skip if edge is added
-            if (ndef == nedge
-                || graph_goes_to (ndef, nedge)
-                || graph_goes_to (nedge, ndef))
-              {
-                continue;
-              }
-            // Skip src for move instruction
-            if (fgraph_is_move (n) && nedge == move_src)
-              {
-                continue;
-              }
-        graph_add_edge (ndef, nedge);
-      }
+  return lg;
+}
+
+/**
+ * Updates the interference graph after spilling. Only the instructions
+ * that were inserted or rewritten get new edges, the live sets of the
+ * others just lost the spilled temps.
+ *
+ * @param lg      The interference graph, its live_out already holds the
+ *                patched sets.
+ * @param removed The temps that no longer occur in the function.
+ * @param changed The inserted and rewritten instructions.
+ */
+void
+live_update (struct live_graph *lg,
+             temp_temp_list    *removed,
+             assem_instr_list  *changed)
+{
+  for (; removed; removed = removed->tail)
+    {
+      graph_node *n = tab_lookup (lg->nodes, removed->head);
+      if (n == NULL)
+        continue;
+      graph_rm_node (n);
+      tab_bind_value (lg->nodes, removed->head, NULL);
     }
-  }
 
-  lg->graph          = g;
-  lg->worklist_moves = worklist_moves;
-  lg->move_list      = move_list;
-  lg->spill_cost     = spill_cost;
+  for (; changed; changed = changed->tail)
+    add_instr (lg, changed->head);
 }
 
+/**
+ * Solves the dataflow equations on the basic blocks and builds the
+ * interference graph.
+ *
+ * Only the blocks take part in the fixpoint iteration. The sets live after
+ * each instruction follow in one walk backwards through every block. They
+ * are kept in the result, so the register allocator can patch them after
+ * spilling instead of analysing the whole function again.
+ *
+ * @param blocks The flow graph of the basic blocks.
+ *
+ * @return The interference graph.
+ */
 struct live_graph
-live_liveness(graph_graph *flow)
+live_liveness (graph_graph *blocks)
 {
   graph_table *in = graph_new_table (), *out = graph_new_table ();
-  get_live_map (flow, in, out);
+  get_live_map (blocks, in, out);
+
+  graph_table *loop_depth = fgraph_loop_depth (blocks);
+  tab_table *live_out = tab_new_table ();
+  tab_table *depth = tab_new_table ();
+  assem_instr_list *il = NULL, *rl, *l;
+  graph_node_list *fl;
+  for (fl = graph_reverse_nodes (graph_nodes (blocks)); fl; fl = fl->tail)
+    {
+      temp_temp_list *live = lookup_live_map (out, fl->head);
+      void           *d    = graph_lookup (loop_depth, fl->head);
+
+      rl = NULL;
+      for (l = fgraph_block_info (fl->head)->instrs; l; l = l->tail)
+        rl = assem_new_instr_list (l->head, rl);
+
+      for (; rl; rl = rl->tail)
+        {
+          assem_instr *inst = rl->head;
+          tab_bind_value (live_out, inst, live);
+          tab_bind_value (depth, inst, d);
+          live = union_temp (fgraph_inst_use (inst),
+                             minus_temp (live, fgraph_inst_def (inst)));
+          il = assem_new_instr_list (inst, il);
+        }
+    }
+
   // Construct interference graph
-  struct live_graph lg;
-  solve_liveness (&lg, flow, in, out);
-  return lg;
+  return live_interference (il, live_out, depth);
 }
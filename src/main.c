@@ -20,19 +20,35 @@
 #include "include/debug.h"
 #include "include/regalloc.h"
 #include "include/prtree.h"
+#include "include/prune.h"
+#include "include/passes.h"
+#include "include/translate.h"
+#include "include/instrument.h"
 
 extern int yyparse(void);
 
 extern absyn_exp *absyn_root;
 extern int        yydebug;
 
-#define NUM_CMD_LINE_ARGS 3 /* Increment if you add a arg */
+#define NUM_CMD_LINE_ARGS 14 /* Increment if you add a arg */
 
 /* Valid cmd line args */
 #define PR_PARSE "--prparse"
 #define PR_ABSYN "--prabsyn"
 #define PR_TREE  "--prtree"
 
+#define REGALLOC_LINEAR    "--regalloc=linear"
+#define REGALLOC_THRESHOLD "--regalloc-threshold="
+
+#define OPT_LEVEL     "-O"
+#define PASSES        "--passes="
+#define VERIFY_PASSES "--verify-passes"
+#define TIME_PASSES   "--time-passes"
+
+#define BOUNDS_CHECK "--bounds-check"
+#define HEAP_PROFILE "--heap-profile"
+#define INSTRUMENT   "--instrument"
+
 /* Global variable for cmd line args */
 int    gargc;
 char** gargv;
@@ -51,6 +67,18 @@ check_cmd_line_arg (char* arg)
   return is_valid;
 }
 
+/* Returns the value of a cmd line arg like --name=value or NULL */
+static char *
+cmd_line_value (char *prefix)
+{
+  for (int i = 0; i < gargc; i++)
+    {
+      if (!strncmp (prefix, gargv[i], strlen (prefix)))
+        return gargv[i] + strlen (prefix);
+    }
+  return NULL;
+}
+
 /*
   Parse source file fname;
   Return abstract syntax data structure
@@ -81,43 +109,25 @@ do_proc (FILE      *out,
          frm_frame *frame,
          tree_stm  *body)
 {
-  assem_proc       *proc;
-  tree_stm_list    *stm_list;
-  assem_instr_list *ilist;
-
- frm_temp_map = temp_new_map ();
- //print_stm_list (stdout, tree_new_stm_list(body, NULL));
+  frm_temp_map = temp_new_map ();
 
- stm_list = canon_linearize (body);
- stm_list = canon_trace_schedule (canon_basic_blocks (stm_list));
+  pas_unit *unit = pas_new_unit (frame, body);
+  pas_run (unit);
 
- if (check_cmd_line_arg (PR_TREE))
+  if (check_cmd_line_arg (PR_TREE))
     {
-      print_stm_list (stdout, stm_list);
+      print_stm_list (stdout, unit->stms);
       fprintf(stdout, "\n");
     }
- ilist  = codegen (frame, stm_list); /* 9 */
- //assem_print_instr_list (out, ilist, temp_layer_map(frm_temp_map, temp_name()));
-
- struct regalloc_result ra = regalloc_do (frame, ilist);  /* 10, 11 */
- ilist = ra.il;
-
- ilist = frm_proc_entry_exit2 (ilist);
- proc = frm_proc_entry_exit3 (frame, ilist);
-
- fprintf(out, "%s\n", proc->prolog);
- assem_print_instr_list (out,
-                         proc->body,
-                         temp_layer_map (frm_temp_map,
-                                         temp_layer_map (ra.coloring,
-                                                         temp_name())));
- fprintf(out, "%s\n", proc->epilog);
-
-//  fprintf(out, "BEGIN function\n");
-//  assem_printInstrList (out, iList,
-//                     Temp_layerMap(F_tempMap,
-//                                   Temp_layerMap(ra.coloring, Temp_name())));
-//  fprintf(out, "END function\n\n");
+
+  assem_proc *proc = unit->proc;
+  fprintf(out, "%s\n", proc->prolog);
+  assem_print_instr_list (out,
+                          proc->body,
+                          temp_layer_map (frm_temp_map,
+                                          temp_layer_map (unit->coloring,
+                                                          temp_name())));
+  fprintf(out, "%s\n", proc->epilog);
 }
 
 char *
@@ -192,6 +202,7 @@ do_str (FILE       *out,
 {
   fprintf (out, "%s:\n", temp_label_str (label));
   fprintf (out, "    .long 0x%lx\n", strlen (str));
+  fprintf (out, "    .long 0\n"); /* hash, computed by the runtime */
   fprintf (out, "    .ascii \"%s\"\n", expand_escapes (str));
   fprintf (out, "\n");
 }
@@ -211,6 +222,22 @@ main (int    argc,
       exit(1);
     }
 
+  char *threshold = cmd_line_value (REGALLOC_THRESHOLD);
+  regalloc_set_linear_scan (check_cmd_line_arg (REGALLOC_LINEAR),
+                            threshold ? atol (threshold) : RA_LINEAR_THRESHOLD);
+
+  char *level  = cmd_line_value (OPT_LEVEL);
+  char *passes = cmd_line_value (PASSES);
+  if ((level != NULL && !pas_set_level (atoi (level)))
+      || (passes != NULL && !pas_set_passes (passes)))
+    exit(1);
+  pas_set_verify (check_cmd_line_arg (VERIFY_PASSES));
+  pas_set_timing (check_cmd_line_arg (TIME_PASSES));
+  tra_set_bounds_check (check_cmd_line_arg (BOUNDS_CHECK));
+  tra_set_heap_profile (check_cmd_line_arg (HEAP_PROFILE));
+  if (check_cmd_line_arg (INSTRUMENT))
+    pas_set_instrument ();
+
   absyn_exp *root = parse (argv[1]);
   if (check_cmd_line_arg (PR_ABSYN))
     {
@@ -223,6 +250,9 @@ main (int    argc,
   if (errm_any_errors)
     return 1;
 
+  /* Drop functions and strings that are never used */
+  frag_list = prn_reachable_frags (frag_list);
+
   /* Convert filename */
   sprintf (outfile, "%s.S", argv[1]);
   out = fopen(outfile, "w");
@@ -242,6 +272,15 @@ main (int    argc,
       if (frag->kind == FRM_STRING_FRAG)
         do_str (out, frag->u.str.str, frag->u.str.label);
     }
+  ins_emit (out);
+  if (tra_display_label () != NULL)
+    fprintf (out, ".comm %s, %d, 4\n",
+             temp_label_str (tra_display_label ()),
+             tra_display_size () * frm_word_size);
   fclose (out);
-  return 0;
+
+  if (check_cmd_line_arg (TIME_PASSES))
+    pas_print_times (stderr);
+
+  return errm_any_errors;
 }
@@ -0,0 +1,607 @@
+/**
+ * @file passes.c
+ * Pass manager of the back end.
+ *
+ * A pass moves a unit from one stage to the next, so a list of passes is
+ * only valid if every pass starts at the stage the one before ended at,
+ * from the tree of a function up to the finished procedure. A new pass
+ * goes into the table below and can then be named in --passes= or in the
+ * presets of the optimization levels.
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "include/util.h"
+#include "include/errormsg.h"
+#include "include/temp.h"
+#include "include/tree.h"
+#include "include/canon.h"
+#include "include/assem.h"
+#include "include/frame.h"
+#include "include/codegen.h"
+#include "include/regalloc.h"
+#include "include/linearscan.h"
+#include "include/instrument.h"
+#include "include/passes.h"
+
+/* Maximal number of passes in a pipeline */
+#define PAS_MAX_PASSES 32
+
+typedef struct _pass pass;
+
+struct
+_pass
+{
+  char     *name;
+  pas_stage from, to;
+  void    (*run)    (pas_unit *unit);
+  char *  (*verify) (pas_unit *unit);  /* Error message or NULL */
+  clock_t   time;                      /* Summed up over all functions */
+};
+
+/* Local function declarations */
+
+static void   run_linearize    (pas_unit *unit);
+
+static void   run_blocks       (pas_unit *unit);
+
+static void   run_instrument   (pas_unit *unit);
+
+static void   run_trace        (pas_unit *unit);
+
+static void   run_codegen      (pas_unit *unit);
+
+static void   run_regalloc     (pas_unit *unit);
+
+static void   run_regalloc_split (pas_unit *unit);
+
+static void   run_linear_scan  (pas_unit *unit);
+
+static void   run_frame        (pas_unit *unit);
+
+static char * verify_stms      (pas_unit *unit);
+
+static char * verify_blocks    (pas_unit *unit);
+
+static char * verify_trace     (pas_unit *unit);
+
+static char * verify_assem     (pas_unit *unit);
+
+static char * verify_allocated (pas_unit *unit);
+
+/* End local function declarations */
+
+static pass passes[] =
+  {
+    { "linearize",   PAS_TREE,      PAS_STMS,      run_linearize,
+      verify_stms,      0 },
+    { "blocks",      PAS_STMS,      PAS_BLOCKS,    run_blocks,
+      verify_blocks,    0 },
+    { "instrument",  PAS_BLOCKS,    PAS_BLOCKS,    run_instrument,
+      verify_blocks,    0 },
+    { "trace",       PAS_BLOCKS,    PAS_STMS,      run_trace,
+      verify_trace,     0 },
+    { "codegen",     PAS_STMS,      PAS_ASSEM,     run_codegen,
+      verify_assem,     0 },
+    { "regalloc",    PAS_ASSEM,     PAS_ALLOCATED, run_regalloc,
+      verify_allocated, 0 },
+    { "regalloc-split", PAS_ASSEM,  PAS_ALLOCATED, run_regalloc_split,
+      verify_allocated, 0 },
+    { "linear-scan", PAS_ASSEM,     PAS_ALLOCATED, run_linear_scan,
+      verify_allocated, 0 },
+    { "frame",       PAS_ALLOCATED, PAS_PROC,      run_frame,
+      NULL,             0 }
+  };
+
+/* Passes of -O0, -O1 and -O2. -O2 also splits live ranges. */
+static char *levels[] =
+  {
+    "linearize,codegen,linear-scan,frame",
+    "linearize,blocks,trace,codegen,regalloc,frame",
+    "linearize,blocks,trace,codegen,regalloc-split,frame"
+  };
+
+static pass *pipeline[PAS_MAX_PASSES];
+static int   num_passes = 0;
+static bool  verify     = false;
+static bool  timing     = false;
+
+/**
+ * Selects the passes of an optimization level.
+ *
+ * @param level 0, 1 or 2.
+ *
+ * @return false if there is no such level.
+ */
+bool
+pas_set_level (int level)
+{
+  if (level < 0 || level >= (int)(sizeof (levels) / sizeof (levels[0])))
+    {
+      fprintf (stderr, "unknown optimization level %d\n", level);
+      return false;
+    }
+  return pas_set_passes (levels[level]);
+}
+
+static pass *
+find_pass (char *name)
+{
+  size_t i;
+  for (i = 0; i < sizeof (passes) / sizeof (passes[0]); i++)
+    {
+      if (strcmp (passes[i].name, name) == 0)
+        return &passes[i];
+    }
+  return NULL;
+}
+
+/**
+ * Selects the passes to run.
+ *
+ * @param names Comma separated pass names, in the order they run.
+ *
+ * @return false if a pass is unknown or does not fit to the one before.
+ */
+bool
+pas_set_passes (char *names)
+{
+  char     *copy  = string_new (names);
+  pas_stage stage = PAS_TREE;
+  int       n     = 0;
+  char     *name;
+
+  for (name = strtok (copy, ","); name; name = strtok (NULL, ","))
+    {
+      pass *p = find_pass (name);
+      if (p == NULL)
+        {
+          fprintf (stderr, "unknown pass %s\n", name);
+          return false;
+        }
+      if (p->from != stage)
+        {
+          fprintf (stderr, "pass %s can not run at this point\n", name);
+          return false;
+        }
+      if (n == PAS_MAX_PASSES)
+        {
+          fprintf (stderr, "too many passes\n");
+          return false;
+        }
+      pipeline[n++] = p;
+      stage = p->to;
+    }
+
+  if (stage != PAS_PROC)
+    {
+      fprintf (stderr, "passes do not end with a procedure\n");
+      return false;
+    }
+  num_passes = n;
+  return true;
+}
+
+/**
+ * Checks the unit after every pass.
+ */
+void
+pas_set_verify (bool v)
+{
+  verify = v;
+}
+
+/**
+ * Measures the time of every pass.
+ */
+void
+pas_set_timing (bool t)
+{
+  timing = t;
+}
+
+/**
+ * Adds the instrument pass behind the basic blocks of the selected
+ * pipeline, unless it is already there. A pipeline without basic blocks
+ * gets them for it.
+ */
+void
+pas_set_instrument (void)
+{
+  pass *instrument = find_pass ("instrument");
+  int   i, j;
+
+  if (num_passes == 0)
+    pas_set_level (PAS_DEFAULT_LEVEL);
+
+  /* Already named in --passes= */
+  for (i = 0; i < num_passes; i++)
+    if (pipeline[i] == instrument)
+      return;
+
+  for (i = 0; i < num_passes && pipeline[i]->to != PAS_STMS; i++)
+    ;
+  if (i == num_passes || num_passes + 3 > PAS_MAX_PASSES)
+    return;
+
+  /* Behind the first pass that leaves basic blocks, or after linearize */
+  for (j = i + 1; j < num_passes && pipeline[j]->to != PAS_BLOCKS; j++)
+    ;
+  if (j < num_passes)
+    {
+      memmove (pipeline + j + 2, pipeline + j + 1,
+               (num_passes - j - 1) * sizeof (pipeline[0]));
+      pipeline[j + 1] = instrument;
+      num_passes += 1;
+    }
+  else
+    {
+      memmove (pipeline + i + 4, pipeline + i + 1,
+               (num_passes - i - 1) * sizeof (pipeline[0]));
+      pipeline[i + 1] = find_pass ("blocks");
+      pipeline[i + 2] = instrument;
+      pipeline[i + 3] = find_pass ("trace");
+      num_passes += 3;
+    }
+}
+
+/**
+ * Creates a unit for the body of a function.
+ */
+pas_unit *
+pas_new_unit (frm_frame *frame,
+              tree_stm  *body)
+{
+  pas_unit *unit = new (sizeof (*unit));
+
+  unit->frame    = frame;
+  unit->stage    = PAS_TREE;
+  unit->body     = body;
+  unit->stms     = NULL;
+  unit->il       = NULL;
+  unit->coloring = NULL;
+  unit->proc     = NULL;
+
+  return unit;
+}
+
+/**
+ * Runs the selected passes over a unit.
+ */
+void
+pas_run (pas_unit *unit)
+{
+  int i;
+
+  if (num_passes == 0)
+    pas_set_level (PAS_DEFAULT_LEVEL);
+
+  for (i = 0; i < num_passes; i++)
+    {
+      pass   *p     = pipeline[i];
+      clock_t start = timing ? clock () : 0;
+
+      assert (unit->stage == p->from);
+      p->run (unit);
+      unit->stage = p->to;
+
+      if (timing)
+        p->time += clock () - start;
+
+      if (verify && p->verify != NULL)
+        {
+          char *msg = p->verify (unit);
+          if (msg != NULL)
+            errm_printf (0, "after pass %s: %s", p->name, msg);
+        }
+    }
+}
+
+/**
+ * Prints the time spent in every pass of the pipeline.
+ */
+void
+pas_print_times (FILE *out)
+{
+  clock_t total = 0;
+  size_t  i;
+
+  for (i = 0; i < sizeof (passes) / sizeof (passes[0]); i++)
+    {
+      if (passes[i].time == 0)
+        continue;
+      fprintf (out, "%-12s %8.3f s\n", passes[i].name,
+               (double)passes[i].time / CLOCKS_PER_SEC);
+      total += passes[i].time;
+    }
+  fprintf (out, "%-12s %8.3f s\n", "total", (double)total / CLOCKS_PER_SEC);
+}
+
+static void
+run_linearize (pas_unit *unit)
+{
+  unit->stms = canon_linearize (unit->body);
+}
+
+static void
+run_blocks (pas_unit *unit)
+{
+  unit->block = canon_basic_blocks (unit->stms);
+  unit->stms  = NULL;
+}
+
+static void
+run_instrument (pas_unit *unit)
+{
+  unit->block = ins_count_blocks (frm_name (unit->frame), unit->block);
+}
+
+static void
+run_trace (pas_unit *unit)
+{
+  unit->stms = canon_trace_schedule (unit->block);
+}
+
+static void
+run_codegen (pas_unit *unit)
+{
+  unit->il = codegen (unit->frame, unit->stms);
+}
+
+static void
+run_regalloc (pas_unit *unit)
+{
+  struct regalloc_result ra = regalloc_do (unit->frame, unit->il, false);
+  unit->il       = ra.il;
+  unit->coloring = ra.coloring;
+}
+
+/* Like regalloc, but splits live ranges before spilling */
+static void
+run_regalloc_split (pas_unit *unit)
+{
+  struct regalloc_result ra = regalloc_do (unit->frame, unit->il, true);
+  unit->il       = ra.il;
+  unit->coloring = ra.coloring;
+}
+
+static void
+run_linear_scan (pas_unit *unit)
+{
+  struct regalloc_result ra = lsc_allocate (unit->frame, unit->il);
+  unit->il       = ra.il;
+  unit->coloring = ra.coloring;
+}
+
+static void
+run_frame (pas_unit *unit)
+{
+  assem_instr_list *il = frm_proc_entry_exit2 (unit->frame, unit->il,
+                                               unit->coloring);
+  unit->proc = frm_proc_entry_exit3 (unit->frame, il);
+}
+
+/**
+ * Checks that an expression has no ESEQ and no CALL, unless call_ok.
+ */
+static char *
+verify_exp (tree_exp *exp,
+            bool      call_ok)
+{
+  char          *msg;
+  tree_exp_list *args;
+
+  switch (exp->kind)
+    {
+    case TREE_BINOP:
+      if ((msg = verify_exp (exp->u.bin_op.left, false)) != NULL)
+        return msg;
+      return verify_exp (exp->u.bin_op.right, false);
+
+    case TREE_MEM:
+      return verify_exp (exp->u.mem, false);
+
+    case TREE_TEMP:
+    case TREE_NAME:
+    case TREE_CONST:
+      return NULL;
+
+    case TREE_ESEQ:
+      return "ESEQ left";
+
+    case TREE_CALL:
+      if (!call_ok)
+        return "CALL inside of an expression";
+      for (args = exp->u.call.args; args; args = args->tail)
+        {
+          if ((msg = verify_exp (args->head, false)) != NULL)
+            return msg;
+        }
+      return verify_exp (exp->u.call.fun, false);
+    }
+  assert (0);
+}
+
+/**
+ * Checks the properties of canon_linearize(): no SEQ and no ESEQ and the
+ * parent of every CALL is an EXP or a MOVE. The destination of the MOVE
+ * can also be a MEM, its address is evaluated before the call.
+ */
+static char *
+verify_stm (tree_stm *stm)
+{
+  char *msg;
+
+  switch (stm->kind)
+    {
+    case TREE_SEQ:
+      return "SEQ left";
+
+    case TREE_LABEL:
+      return NULL;
+
+    case TREE_JUMP:
+      return verify_exp (stm->u.jmp.exp, false);
+
+    case TREE_CJUMP:
+      if ((msg = verify_exp (stm->u.cjump.left, false)) != NULL)
+        return msg;
+      return verify_exp (stm->u.cjump.right, false);
+
+    case TREE_MOVE:
+      if ((msg = verify_exp (stm->u.move.dst, false)) != NULL)
+        return msg;
+      return verify_exp (stm->u.move.src, true);
+
+    case TREE_EXP:
+      return verify_exp (stm->u.exp, true);
+    }
+  assert (0);
+}
+
+static char *
+verify_stm_list (tree_stm_list *stms)
+{
+  char *msg;
+  for (; stms; stms = stms->tail)
+    {
+      if ((msg = verify_stm (stms->head)) != NULL)
+        return msg;
+    }
+  return NULL;
+}
+
+static char *
+verify_stms (pas_unit *unit)
+{
+  return verify_stm_list (unit->stms);
+}
+
+static bool
+is_jump_stm (tree_stm *stm)
+{
+  return stm->kind == TREE_JUMP || stm->kind == TREE_CJUMP;
+}
+
+/**
+ * Checks that every block starts with its only label and ends with its
+ * only jump.
+ */
+static char *
+verify_blocks (pas_unit *unit)
+{
+  canon_stmlist_list *bl;
+  char               *msg;
+
+  for (bl = unit->block.stm_lists; bl; bl = bl->tail)
+    {
+      tree_stm_list *stms = bl->head;
+      if (stms == NULL || stms->head->kind != TREE_LABEL)
+        return "block without label";
+
+      for (stms = stms->tail; stms; stms = stms->tail)
+        {
+          if (stms->head->kind == TREE_LABEL)
+            return "label inside of a block";
+          if (is_jump_stm (stms->head) != (stms->tail == NULL))
+            return "block does not end with its jump";
+        }
+      if ((msg = verify_stm_list (bl->head)) != NULL)
+        return msg;
+    }
+  return NULL;
+}
+
+/**
+ * Checks that every CJUMP is followed by its false label.
+ */
+static char *
+verify_trace (pas_unit *unit)
+{
+  tree_stm_list *stms;
+
+  for (stms = unit->stms; stms; stms = stms->tail)
+    {
+      tree_stm *stm = stms->head;
+      if (stm->kind == TREE_CJUMP
+          && (stms->tail == NULL
+              || stms->tail->head->kind != TREE_LABEL
+              || stms->tail->head->u.label != stm->u.cjump.falsee))
+        return "CJUMP not followed by its false label";
+    }
+  return verify_stms (unit);
+}
+
+/**
+ * Checks that every jump goes to a label of the function.
+ */
+static char *
+verify_assem (pas_unit *unit)
+{
+  temp_label_list  *labels = NULL, *ll;
+  assem_instr_list *il;
+
+  for (il = unit->il; il; il = il->tail)
+    {
+      if (il->head->kind == I_LABEL)
+        labels = temp_new_label_list (il->head->u.label.label, labels);
+    }
+
+  for (il = unit->il; il; il = il->tail)
+    {
+      assem_instr *inst = il->head;
+      if (inst->kind != I_OPER || inst->u.oper.jumps == NULL)
+        continue;
+
+      for (ll = inst->u.oper.jumps->labels; ll; ll = ll->tail)
+        {
+          temp_label_list *l = labels;
+          while (l != NULL && l->head != ll->head)
+            l = l->tail;
+          if (l == NULL)
+            return "jump to a missing label";
+        }
+    }
+  return NULL;
+}
+
+static char *
+verify_colored (temp_map       *coloring,
+                temp_temp_list *tl)
+{
+  for (; tl; tl = tl->tail)
+    {
+      if (temp_lookup (coloring, tl->head) == NULL)
+        return "temp without register";
+    }
+  return NULL;
+}
+
+/**
+ * Checks that every temp got a register.
+ */
+static char *
+verify_allocated (pas_unit *unit)
+{
+  assem_instr_list *il;
+  char             *msg;
+
+  for (il = unit->il; il; il = il->tail)
+    {
+      assem_instr *inst = il->head;
+      if (inst->kind == I_OPER
+          && ((msg = verify_colored (unit->coloring, inst->u.oper.src))
+              || (msg = verify_colored (unit->coloring, inst->u.oper.dst))))
+        return msg;
+      if (inst->kind == I_MOVE
+          && ((msg = verify_colored (unit->coloring, inst->u.move.src))
+              || (msg = verify_colored (unit->coloring, inst->u.move.dst))))
+        return msg;
+    }
+  return verify_assem (unit);
+}
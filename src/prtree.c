@@ -147,7 +147,7 @@ pr_tree_exp (FILE *out,
       {
         tree_exp_list *args = exp->u.call.args;
         indent(out,d);
-        fprintf(out, "CALL(\n");
+        fprintf(out, exp->u.call.tail ? "TAILCALL(\n" : "CALL(\n");
         pr_tree_exp(out, exp->u.call.fun, d + 1);
         for (;args; args=args->tail)
           {
@@ -0,0 +1,175 @@
+/**
+ * @file prune.c
+ * Builds the call graph of the procedure fragments and drops all
+ * fragments that are not reachable from tigermain.
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "include/util.h"
+#include "include/table.h"
+#include "include/temp.h"
+#include "include/tree.h"
+#include "include/frame.h"
+#include "include/prune.h"
+
+/* Local function declarations */
+
+static void visit_stm (tab_table *frags,
+                       tab_table *reached,
+                       tree_stm  *stm_ptr);
+
+static void visit_exp (tab_table *frags,
+                       tab_table *reached,
+                       tree_exp  *exp_ptr);
+
+static void reach     (tab_table  *frags,
+                       tab_table  *reached,
+                       temp_label *label_ptr);
+
+static temp_label * frag_label (frm_frag *frag_ptr);
+
+/* End local function declarations */
+
+
+/**
+ * Removes all procedure and string fragments that are not referenced
+ * from tigermain, directly or over other procedures.
+ *
+ * @param frags_ptr All fragments of the program.
+ *
+ * @return The reachable fragments in their original order.
+ */
+frm_frag_list *
+prn_reachable_frags (frm_frag_list *frags_ptr)
+{
+  tab_table     *frags   = tab_new_table (); /* Label to fragment */
+  tab_table     *reached = tab_new_table (); /* Label to fragment */
+  frm_frag_list *l;
+
+  for (l = frags_ptr; l != NULL; l = l->tail)
+    tab_bind_value (frags, frag_label (l->head), l->head);
+
+  reach (frags, reached, temp_named_label ("tigermain"));
+
+  frm_frag_list *result = NULL, *last = NULL;
+  for (l = frags_ptr; l != NULL; l = l->tail)
+    {
+      if (tab_lookup (reached, frag_label (l->head)) == NULL)
+        continue;
+
+      frm_frag_list *f = frm_new_frag_list (l->head, NULL);
+      if (last == NULL)
+        result = last = f;
+      else
+        last = last->tail = f;
+    }
+  return result;
+}
+
+/*
+  Marks the fragment of a label as reached and visits the body
+  the first time a procedure is reached.
+*/
+static void
+reach (tab_table  *frags,
+       tab_table  *reached,
+       temp_label *label_ptr)
+{
+  frm_frag *frag = tab_lookup (frags, label_ptr);
+  if (frag == NULL || tab_lookup (reached, label_ptr) != NULL)
+    return;
+
+  tab_bind_value (reached, label_ptr, frag);
+  if (frag->kind == FRM_PROC_FRAG)
+    visit_stm (frags, reached, frag->u.proc.body);
+}
+
+static void
+visit_stm (tab_table *frags,
+           tab_table *reached,
+           tree_stm  *stm_ptr)
+{
+  switch (stm_ptr->kind)
+    {
+    case TREE_SEQ:
+      visit_stm (frags, reached, stm_ptr->u.seq.left);
+      visit_stm (frags, reached, stm_ptr->u.seq.right);
+      return;
+
+    case TREE_LABEL:
+      return;
+
+    case TREE_JUMP:
+      visit_exp (frags, reached, stm_ptr->u.jmp.exp);
+      return;
+
+    case TREE_CJUMP:
+      visit_exp (frags, reached, stm_ptr->u.cjump.left);
+      visit_exp (frags, reached, stm_ptr->u.cjump.right);
+      return;
+
+    case TREE_MOVE:
+      visit_exp (frags, reached, stm_ptr->u.move.dst);
+      visit_exp (frags, reached, stm_ptr->u.move.src);
+      return;
+
+    case TREE_EXP:
+      visit_exp (frags, reached, stm_ptr->u.exp);
+      return;
+    }
+  assert (0);
+}
+
+static void
+visit_exp (tab_table *frags,
+           tab_table *reached,
+           tree_exp  *exp_ptr)
+{
+  switch (exp_ptr->kind)
+    {
+    case TREE_BINOP:
+      visit_exp (frags, reached, exp_ptr->u.bin_op.left);
+      visit_exp (frags, reached, exp_ptr->u.bin_op.right);
+      return;
+
+    case TREE_MEM:
+      visit_exp (frags, reached, exp_ptr->u.mem);
+      return;
+
+    case TREE_ESEQ:
+      visit_stm (frags, reached, exp_ptr->u.eseq.stm);
+      visit_exp (frags, reached, exp_ptr->u.eseq.exp);
+      return;
+
+    case TREE_NAME:
+      reach (frags, reached, exp_ptr->u.name);
+      return;
+
+    case TREE_CALL:
+      {
+        visit_exp (frags, reached, exp_ptr->u.call.fun);
+
+        tree_exp_list *args = exp_ptr->u.call.args;
+        for (; args != NULL; args = args->tail)
+          visit_exp (frags, reached, args->head);
+        return;
+      }
+
+    case TREE_TEMP:
+    case TREE_CONST:
+      return;
+    }
+  assert (0);
+}
+
+static temp_label *
+frag_label (frm_frag *frag_ptr)
+{
+  if (frag_ptr->kind == FRM_STRING_FRAG)
+    return frag_ptr->u.str.label;
+
+  return frm_name (frag_ptr->u.proc.frame);
+}
@@ -0,0 +1,273 @@
+/**
+ * @file recescape.c
+ * Goes through abstract syntax tree and looks for records that do not escape.
+ *
+ * A record escapes if the variable holding it is used as a value (passed,
+ * returned, compared or assigned), if the variable gets assigned or if it is
+ * used in a nested function. All other record variables get marked as local
+ * records and are replaced by scalars in the semantic analyse.
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "include/errormsg.h"
+#include "include/symbol.h"
+#include "include/util.h"
+#include "include/recescape.h"
+
+
+typedef struct _rec_entry rec_entry;
+
+struct
+_rec_entry
+{
+  int        depth;
+  absyn_dec *dec;   /* Declaration of a candidate, NULL for other variables */
+};
+
+/* Local function declaration */
+
+static void        traverse_exp     (sym_table *env_ptr,
+                                     int        depth,
+                                     absyn_exp *exp_ptr);
+
+static void        traverse_dec     (sym_table *env_ptr,
+                                     int        depth,
+                                     absyn_dec *dec_ptr);
+
+static void        traverse_var     (sym_table *env_ptr,
+                                     int        depth,
+                                     absyn_var *var_ptr,
+                                     bool       field_base);
+
+static void        traverse_formals (sym_table         *env_ptr,
+                                     int                depth,
+                                     absyn_fundec_list *fundec_list_ptr);
+
+static rec_entry * new_rec_entry    (int        depth,
+                                     absyn_dec *dec_ptr);
+
+
+
+/**
+ * Looks for record variables that can be replaced by scalars,
+ * marks them with true.
+ *
+ * @param exp_ptr Expression to check.
+ */
+void
+rec_find_local_records (absyn_exp *exp_ptr)
+{
+  sym_table *rec_env = sym_new_table ();
+  traverse_exp (rec_env, 0, exp_ptr);
+}
+
+
+static void
+traverse_exp (sym_table *env_ptr,
+              int        depth,
+              absyn_exp *exp_ptr)
+{
+  if (exp_ptr == NULL)
+    return;
+
+  switch (exp_ptr->kind)
+    {
+    case ABSYN_VAR_EXP:
+      return traverse_var (env_ptr, depth, exp_ptr->u.var, false);
+
+    case ABSYN_CALL_EXP:
+      {
+        absyn_exp_list *list = exp_ptr->u.call.args;
+        for (; list != NULL; list = list->tail)
+          traverse_exp (env_ptr, depth, list->head);
+        return;
+      }
+
+    case ABSYN_RECORD_EXP:
+      {
+        absyn_efield_list *list = exp_ptr->u.record.fields;
+        for (; list != NULL; list = list->tail)
+          traverse_exp (env_ptr, depth, list->head->exp);
+        return;
+      }
+
+    case ABSYN_SEQ_EXP:
+      {
+        absyn_exp_list *list = exp_ptr->u.seq;
+        for (; list != NULL; list = list->tail)
+          traverse_exp (env_ptr, depth, list->head);
+        return;
+      }
+
+    case ABSYN_IF_EXP:
+      traverse_exp (env_ptr, depth, exp_ptr->u.iff.test);
+      traverse_exp (env_ptr, depth, exp_ptr->u.iff.then);
+      traverse_exp (env_ptr, depth, exp_ptr->u.iff.elsee);
+      return;
+
+    case ABSYN_WHILE_EXP:
+      traverse_exp (env_ptr, depth, exp_ptr->u.whilee.test);
+      traverse_exp (env_ptr, depth, exp_ptr->u.whilee.body);
+      return;
+
+    case ABSYN_FOR_EXP:
+      traverse_exp (env_ptr, depth, exp_ptr->u.forr.lo);
+      traverse_exp (env_ptr, depth, exp_ptr->u.forr.hi);
+
+      sym_begin_scope (env_ptr);
+      sym_bind_symbol (env_ptr,
+                       exp_ptr->u.forr.var,
+                       new_rec_entry (depth, NULL));
+      traverse_exp (env_ptr, depth, exp_ptr->u.forr.body);
+      sym_end_scope (env_ptr);
+      return;
+
+    case ABSYN_ARRAY_EXP:
+      traverse_exp (env_ptr, depth, exp_ptr->u.array.size);
+      traverse_exp (env_ptr, depth, exp_ptr->u.array.init);
+      return;
+
+    case ABSYN_LET_EXP:
+      {
+        sym_begin_scope (env_ptr);
+
+        absyn_dec_list *list = exp_ptr->u.let.decs;
+        for (; list != NULL; list = list->tail)
+          traverse_dec (env_ptr, depth, list->head);
+
+        traverse_exp (env_ptr, depth, exp_ptr->u.let.body);
+        sym_end_scope (env_ptr);
+        return;
+      }
+
+    case ABSYN_OP_EXP:
+      traverse_exp (env_ptr, depth, exp_ptr->u.op.left);
+      traverse_exp (env_ptr, depth, exp_ptr->u.op.right);
+      return;
+
+    case ABSYN_ASSIGN_EXP:
+      traverse_var (env_ptr, depth, exp_ptr->u.assign.var, false);
+      traverse_exp (env_ptr, depth, exp_ptr->u.assign.exp);
+      return;
+
+    case ABSYN_NIL_EXP:
+    case ABSYN_INT_EXP:
+    case ABSYN_STR_EXP:
+    case ABSYN_BREAK_EXP:
+      return;
+    }
+  errm_impossible ("Got over switch in traverse_exp()!\n");
+}
+
+static void
+traverse_dec (sym_table *env_ptr,
+              int        depth,
+              absyn_dec *dec_ptr)
+{
+  if (dec_ptr == NULL)
+    return;
+
+  switch (dec_ptr->kind)
+    {
+    case ABSYN_FUNCTION_DEC:
+      return traverse_formals (env_ptr, depth, dec_ptr->u.function);
+
+    case ABSYN_TYPE_DEC:
+      return;
+
+    case ABSYN_VAR_DEC:
+      {
+        traverse_exp (env_ptr, depth, dec_ptr->u.var.init);
+
+        absyn_dec *candidate = NULL;
+        if (dec_ptr->u.var.init->kind == ABSYN_RECORD_EXP)
+          {
+            candidate = dec_ptr;
+            dec_ptr->u.var.local_record = true;
+          }
+        sym_bind_symbol (env_ptr,
+                         dec_ptr->u.var.var,
+                         new_rec_entry (depth, candidate));
+        return;
+      }
+    }
+  errm_impossible ("Got over switch in traverse_dec()!\n");
+}
+
+/*
+  A candidate may only appear as the record of a field variable
+  in the function it is declared in.
+*/
+static void
+traverse_var (sym_table *env_ptr,
+              int        depth,
+              absyn_var *var_ptr,
+              bool       field_base)
+{
+  if (var_ptr == NULL)
+    return;
+
+  switch (var_ptr->kind)
+    {
+    case ABSYN_SIMPLE_VAR:
+      {
+        rec_entry *declared_var = sym_lookup (env_ptr, var_ptr->u.simple);
+        if (declared_var != NULL
+            && declared_var->dec != NULL
+            && (!field_base || declared_var->depth != depth))
+          declared_var->dec->u.var.local_record = false;
+        return;
+      }
+
+    case ABSYN_FIELD_VAR:
+      return traverse_var (env_ptr, depth, var_ptr->u.field.var, true);
+
+    case ABSYN_SUBSCRIPT_VAR:
+      traverse_var (env_ptr, depth, var_ptr->u.subscript.var, false);
+      return traverse_exp (env_ptr, depth, var_ptr->u.subscript.exp);
+    }
+
+  errm_impossible ("Got over switch in traverse_var()!\n");
+}
+
+static rec_entry *
+new_rec_entry (int        depth,
+               absyn_dec *dec_ptr)
+{
+  rec_entry *entry = new (sizeof (*entry));
+
+  entry->depth = depth;
+  entry->dec   = dec_ptr;
+
+  return entry;
+}
+
+/*
+  Go trough parameter list of function, declare the parameters,
+  so they hide candidates with the same name, and then process body
+*/
+static void
+traverse_formals (sym_table         *env_ptr,
+                  int                depth,
+                  absyn_fundec_list *fundec_list_ptr)
+{
+  absyn_fundec_list *list = fundec_list_ptr;
+  for (; list != NULL; list = list->tail)
+    {
+      sym_begin_scope (env_ptr);
+
+      absyn_fundec     *fundec      = list->head;
+      absyn_field_list *params_list = fundec->params;
+
+      for (; params_list != NULL; params_list = params_list->tail)
+        sym_bind_symbol (env_ptr,
+                         params_list->head->name,
+                         new_rec_entry (depth + 1, NULL));
+
+      traverse_exp (env_ptr, depth + 1, fundec->body);
+      sym_end_scope (env_ptr);
+    }
+}
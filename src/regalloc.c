@@ -3,6 +3,7 @@
  * Register allocation for x86.
  */
 #include <assert.h>
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -19,9 +20,17 @@
 #include "include/color.h"
 #include "include/flowgraph.h"
 #include "include/liveness.h"
+#include "include/linearscan.h"
 #include "include/regalloc.h"
+#include "include/split.h"
 #include "include/table.h"
 
+/* Spill cost of temps created by spilling, they should never spill again */
+#define SPILL_TEMP_COST 100000000
+
+static bool linear_scan      = false;
+static long linear_threshold = RA_LINEAR_THRESHOLD;
+
 static void
 print_temp (void* t) {
   temp_map *m = temp_name();
@@ -46,37 +55,6 @@ reverse_instr_list (assem_instr_list *il)
   return rl;
 }
 
-static temp_temp_list *
-inst_def (assem_instr *inst)
-{
-  switch (inst->kind)
-    {
-    case I_OPER:
-      return inst->u.oper.dst;
-    case I_LABEL:
-      return NULL;
-    case I_MOVE:
-      return inst->u.move.dst;
-    default:
-      assert (0);
-    }
-}
-
-static temp_temp_list *
-inst_use (assem_instr *inst)
-{
-  switch (inst->kind)
-    {
-    case I_OPER:
-      return inst->u.oper.src;
-    case I_LABEL:
-      return NULL;
-    case I_MOVE:
-      return inst->u.move.src;
-    }
-  return NULL;
-}
-
 static graph_node *
 temp_to_node (temp_temp   *t,
               graph_graph *g)
@@ -159,69 +137,597 @@ aliased (temp_temp_list *tl,
     {
       temp_temp  *t = tl->head;
       graph_node *n = temp_to_node (t, ig);
-      graph_node *alias = get_alias (n, aliases, cn);
-      t = node_to_temp (n);
+      if (n != NULL)
+        t = node_to_temp (get_alias (n, aliases, cn));
       al = temp_new_temp_list (t, al);
     }
   return union_temp (al, NULL);
 }
 
+/**
+ * Replaces each temp in tl whose alias got spilled by a new temp.
+ * A spilled temp is replaced by the same new temp within one instruction,
+ * so two address instructions keep source and destination equal.
+ */
+static temp_temp_list *
+rewrite_temps (temp_temp_list *tl,
+               graph_graph    *ig,
+               graph_table    *aliases,
+               temp_temp_list *cn,
+               temp_temp_list *spilled,
+               tab_table      *fresh,
+               temp_temp_list **new_temps)
+{
+  temp_temp_list *rl = NULL;
+  for (; tl; tl = tl->tail)
+    {
+      temp_temp  *t     = tl->head;
+      graph_node *n     = temp_to_node (t, ig);
+      temp_temp  *alias = n ? node_to_temp (get_alias (n, aliases, cn)) : t;
+
+      if (temp_in (alias, spilled))
+        {
+          temp_temp *nt = tab_lookup (fresh, alias);
+          if (nt == NULL)
+            {
+              nt = temp_new_temp ();
+              tab_bind_value (fresh, alias, nt);
+              *new_temps = temp_new_temp_list (nt, *new_temps);
+            }
+          t = nt;
+        }
+      rl = temp_new_temp_list (t, rl);
+    }
+  return temp_reverse_list (rl);
+}
+
+/**
+ * Checks if an instruction only loads a constant or a label into a temp.
+ */
+static bool
+is_const_load (assem_instr *inst)
+{
+  return inst->kind == I_OPER
+    && inst->u.oper.src == NULL
+    && inst->u.oper.jumps == NULL
+    && inst->u.oper.dst != NULL
+    && inst->u.oper.dst->tail == NULL
+    && strncmp (inst->u.oper.assem, "movl $", 6) == 0;
+}
+
+/**
+ * Finds the temps that can be rematerialized: Every definition loads the
+ * same constant or label (moves inside of a coalesced temp do not count).
+ * Such a temp gets recomputed at its uses instead of stored in the frame.
+ *
+ * Without an interference graph the temps are taken as they are,
+ * otherwise every temp is replaced by its alias.
+ *
+ * @return Table from temp to one of its defining instructions.
+ */
+static tab_table *
+find_remat (assem_instr_list *il,
+            graph_graph      *ig,
+            graph_table      *aliases,
+            temp_temp_list   *cn)
+{
+  tab_table      *remat = tab_new_table ();
+  temp_temp_list *bad   = NULL;
+
+  for (; il; il = il->tail)
+    {
+      assem_instr    *inst = il->head;
+      temp_temp_list *def  = fgraph_inst_def (inst);
+      temp_temp_list *use  = fgraph_inst_use (inst);
+      if (ig != NULL)
+        {
+          def = aliased (def, ig, aliases, cn);
+          use = aliased (use, ig, aliases, cn);
+        }
+
+      for (; def; def = def->tail)
+        {
+          temp_temp   *t    = def->head;
+          assem_instr *prev = tab_lookup (remat, t);
+
+          if (temp_in (t, bad))
+            continue;
+
+          if (inst->kind == I_MOVE && temp_in (t, use))
+            continue;
+
+          if (is_const_load (inst)
+              && (prev == NULL
+                  || strcmp (prev->u.oper.assem, inst->u.oper.assem) == 0))
+            {
+              tab_bind_value (remat, t, inst);
+              continue;
+            }
+          bad = temp_new_temp_list (t, bad);
+        }
+    }
+
+  for (; bad; bad = bad->tail)
+    tab_bind_value (remat, bad->head, NULL);
+
+  return remat;
+}
+
+static bool
+has_mnemonic (char *assem,
+              char *op)
+{
+  size_t len = strlen (op);
+  return strncmp (assem, op, len) == 0 && assem[len] == ' ';
+}
+
+/**
+ * Checks if an instruction has only registers and immediates as operands.
+ */
+static bool
+register_operands (char *assem)
+{
+  char *p = strchr (assem, ' ');
+  while (p != NULL)
+    {
+      while (*p == ' ')
+        p++;
+      if (*p != '`' && *p != '$')
+        return false;
+      p = strchr (p, ',');
+      if (p != NULL)
+        p++;
+    }
+  return true;
+}
+
+/**
+ * Replaces the operand from (like `s1) in assem by to.
+ */
+static char *
+replace_operand (char *assem,
+                 char *from,
+                 char *to)
+{
+  char   buf[256];
+  char  *out = buf;
+  size_t len = strlen (from);
+
+  while (*assem)
+    {
+      if (strncmp (assem, from, len) == 0 && !isdigit (assem[len]))
+        {
+          strcpy (out, to);
+          out   += strlen (to);
+          assem += len;
+        }
+      else
+        *out++ = *assem++;
+    }
+  *out = '\0';
+  return string_new (buf);
+}
+
+/**
+ * Returns the position of the only temp in tl whose alias is t,
+ * -1 if there is none and -2 if there are more.
+ */
+static int
+alias_index (temp_temp_list *tl,
+             temp_temp      *t,
+             graph_graph    *ig,
+             graph_table    *aliases,
+             temp_temp_list *cn)
+{
+  int i, index = -1;
+  for (i = 0; tl; tl = tl->tail, i++)
+    {
+      temp_temp_list *al = aliased (temp_new_temp_list (tl->head, NULL),
+                                    ig, aliases, cn);
+      if (al->head != t)
+        continue;
+      if (index != -1)
+        return -2;
+      index = i;
+    }
+  return index;
+}
+
+static void
+set_nth (temp_temp_list *tl,
+         int             n,
+         temp_temp      *t)
+{
+  for (; n > 0; n--)
+    tl = tl->tail;
+  tl->head = t;
+}
+
+/**
+ * Turns the occurrence of a spilled temp in an instruction into a memory
+ * operand relative to the frame pointer, so it needs no load or store.
+ *
+ * x86 allows one memory operand per instruction. It can be read by
+ * movl, addl, subl, imul, cmp, pushl and divl. Only movl can write it and
+ * addl and subl can update it in place.
+ *
+ * @return true if the temp was folded.
+ */
+static bool
+fold_spill (assem_instr    *inst,
+            temp_temp      *t,
+            int             offset,
+            graph_graph    *ig,
+            graph_table    *aliases,
+            temp_temp_list *cn)
+{
+  char *assem = inst->u.oper.assem;
+  temp_temp_list *src = fgraph_inst_use (inst), *dst = fgraph_inst_def (inst);
+  char sname[16], dname[16], mem[32];
+
+  if (inst->kind == I_LABEL || !register_operands (assem))
+    return false;
+
+  int si = alias_index (src, t, ig, aliases, cn);
+  int di = alias_index (dst, t, ig, aliases, cn);
+  if (si == -2 || di == -2 || (di >= 0 && dst->tail != NULL))
+    return false;
+
+  sprintf (sname, "`s%d", si);
+  sprintf (dname, "`d%d", di);
+  bool in_text = si >= 0 && strstr (assem, sname) != NULL;
+
+  if (di < 0)
+    {
+      /* Read only */
+      if (!in_text
+          || !(has_mnemonic (assem, "movl") || has_mnemonic (assem, "addl")
+               || has_mnemonic (assem, "subl") || has_mnemonic (assem, "imul")
+               || has_mnemonic (assem, "cmp") || has_mnemonic (assem, "pushl")
+               || has_mnemonic (assem, "divl")))
+        return false;
+
+      sprintf (mem, "%d(%s)", offset, sname);
+      assem = replace_operand (assem, sname, mem);
+      set_nth (src, si, frm_fp ());
+    }
+  else if (si < 0)
+    {
+      /* Write only */
+      if (!has_mnemonic (assem, "movl"))
+        return false;
+
+      int n = 0;
+      temp_temp_list *tl;
+      for (tl = src; tl; tl = tl->tail)
+        n++;
+      sprintf (sname, "`s%d", n);
+      sprintf (mem, "%d(%s)", offset, sname);
+      assem = replace_operand (assem, dname, mem);
+      src = temp_reverse_list (temp_new_temp_list (frm_fp (),
+                                                   temp_reverse_list (src)));
+    }
+  else
+    {
+      /* Updated in place, the source of a two address instruction */
+      if (in_text
+          || !(has_mnemonic (assem, "addl") || has_mnemonic (assem, "subl")))
+        return false;
+
+      sprintf (mem, "%d(%s)", offset, sname);
+      assem = replace_operand (assem, dname, mem);
+      set_nth (src, si, frm_fp ());
+    }
+
+  inst->kind           = I_OPER;
+  inst->u.oper.assem   = assem;
+  inst->u.oper.dst     = di < 0 ? dst : NULL;
+  inst->u.oper.src     = src;
+  inst->u.oper.jumps   = NULL;
+  return true;
+}
+
+/**
+ * Removes the temps bound in dead from a list.
+ */
+static temp_temp_list *
+strip_temps (temp_temp_list *tl,
+             tab_table      *dead)
+{
+  temp_temp_list *rl = NULL;
+  for (; tl; tl = tl->tail)
+    {
+      if (tab_lookup (dead, tl->head) == NULL)
+        rl = temp_new_temp_list (tl->head, rl);
+    }
+  return rl;
+}
+
+static temp_temp_list *
+live_in (assem_instr    *inst,
+         temp_temp_list *out)
+{
+  return union_temp (fgraph_inst_use (inst),
+                     temp_minus (out, fgraph_inst_def (inst)));
+}
+
+/**
+ * Finds the temps that can be spilled instead of a temp that was created by
+ * spilling: its neighbors in the interference graph.
+ */
+static temp_temp_list *
+spillable_neighbors (temp_temp      *t,
+                     graph_graph    *ig,
+                     graph_table    *aliases,
+                     temp_temp_list *cn,
+                     temp_map       *precolored,
+                     temp_temp_list *spill_temps)
+{
+  temp_temp_list  *nl  = NULL;
+  graph_node_list *adj = graph_adj (temp_to_node (t, ig));
+  for (; adj; adj = adj->tail)
+    nl = temp_new_temp_list (live_gtemp (adj->head), nl);
+
+  temp_temp_list *rl = NULL;
+  for (nl = aliased (nl, ig, aliases, cn); nl; nl = nl->tail)
+    {
+      if (temp_lookup (precolored, nl->head) == NULL
+          && !temp_in (nl->head, spill_temps))
+        rl = temp_new_temp_list (nl->head, rl);
+    }
+  return rl;
+}
+
+/**
+ * Finds a temp to spill when no neighbor of a stuck temp can be spilled,
+ * they are all registers or temps created by spilling. Spilling the
+ * cheapest temp of the program next to one of these neighbors frees a
+ * register around the stuck temp. If there is none, the cheapest temp of
+ * the program that is still in a register gets spilled.
+ *
+ * @return The alias of the temp to spill, NULL if every temp of the program
+ *         is spilled already.
+ */
+static temp_temp *
+spill_elsewhere (temp_temp_list *stuck,
+                 graph_graph    *ig,
+                 graph_table    *aliases,
+                 temp_temp_list *cn,
+                 temp_map       *precolored,
+                 temp_temp_list *spill_temps,
+                 temp_map       *spill_cost)
+{
+  temp_temp_list  *near = NULL, *all = NULL, *tl;
+  graph_node_list *nl, *adj;
+
+  for (; stuck; stuck = stuck->tail)
+    for (nl = graph_adj (temp_to_node (stuck->head, ig)); nl; nl = nl->tail)
+      for (adj = graph_adj (nl->head); adj; adj = adj->tail)
+        near = temp_new_temp_list (live_gtemp (adj->head), near);
+  for (nl = graph_nodes (ig); nl; nl = nl->tail)
+    all = temp_new_temp_list (live_gtemp (nl->head), all);
+
+  temp_temp_list *candidates[] = { near, all };
+  int i;
+  for (i = 0; i < 2; i++)
+    {
+      temp_temp *best = NULL;
+      long best_cost = 0;
+      for (tl = candidates[i]; tl; tl = tl->tail)
+        {
+          if (temp_in (tl->head, spill_temps))
+            continue;
+          temp_temp *alias =
+            aliased (temp_new_temp_list (tl->head, NULL), ig, aliases, cn)->head;
+          long cost = (long)temp_look_ptr (spill_cost, alias);
+          if (temp_lookup (precolored, alias) != NULL
+              || (best != NULL && cost >= best_cost))
+            continue;
+          best      = alias;
+          best_cost = cost;
+        }
+      if (best != NULL)
+        return best;
+    }
+  return NULL;
+}
+
+/**
+ * Builds the interference graph of the liveness and colors it from scratch.
+ */
+static struct col_result
+color_all (struct live_graph *live,
+           assem_instr_list  *il,
+           temp_map          *initial,
+           temp_temp_list    *spill_temps)
+{
+  temp_temp_list *tl;
+  for (tl = spill_temps; tl; tl = tl->tail)
+    temp_enter_ptr (live->spill_cost, tl->head, (void*)SPILL_TEMP_COST);
+
+  // Recomputing a constant is cheaper than a load from the frame
+  tab_table *cheap = find_remat (il, NULL, NULL, NULL);
+  graph_node_list *nl;
+  for (nl = graph_nodes (live->graph); nl; nl = nl->tail)
+    {
+      temp_temp *t = live_gtemp (nl->head);
+      long cost = (long)temp_look_ptr (live->spill_cost, t);
+      if (tab_lookup (cheap, t) != NULL && cost < SPILL_TEMP_COST)
+        temp_enter_ptr (live->spill_cost, t, (void*)(cost / 2));
+    }
+
+  return col_color (live->graph, live->nodes, initial, frm_registers (),
+                    live->worklist_moves, live->move_list, live->spill_cost);
+}
+
+/**
+ * Selects when the linear scan allocator is used instead of the graph
+ * coloring.
+ *
+ * @param always    Use it for every function.
+ * @param threshold Use it for functions with more instructions, 0 never.
+ */
+void
+regalloc_set_linear_scan (bool always,
+                          long threshold)
+{
+  linear_scan      = always;
+  linear_threshold = threshold;
+}
+
+/**
+ * Allocates registers for the temps of a function.
+ *
+ * The liveness equations are solved and the interference graph is colored
+ * from scratch only once. After spilling, the sets live after the rewritten
+ * instructions get patched, the spilled temps leave the graph and only the
+ * loads, stores and rewritten instructions add edges. The next round keeps
+ * the coalescing of the temps that were not spilled.
+ *
+ * With split, a temp gets its live range split once around loops
+ * or calls before it gets spilled. The liveness is solved again after such
+ * a round.
+ *
+ * Every round spills at least one temp of the original program. A temp
+ * created by spilling lives only from its load to its use, if it still
+ * spills a temp of the program around it gets spilled instead. So there
+ * are never more rounds than temps.
+ */
 struct regalloc_result
 regalloc_do (frm_frame        *f,
-             assem_instr_list *il)
+             assem_instr_list *il,
+             bool              split)
 {
-  //your code here.
   struct regalloc_result ret;
-  bool ra_finished = false;
 
-  graph_graph *flow;
   struct live_graph live;
-  temp_map *initial;
+  temp_map *initial = frm_initial_registers (f);
   struct col_result col;
   assem_instr_list *rewrite_list;
+  temp_temp_list *spill_temps = NULL;
+  temp_temp_list *split_temps = NULL;
+
+  long size = 0;
+  for (rewrite_list = il; rewrite_list; rewrite_list = rewrite_list->tail)
+    size++;
+  if (linear_scan || (linear_threshold > 0 && size > linear_threshold))
+    return lsc_allocate (f, il);
+
+  live = live_liveness (fgraph_block_graph (il));
+  col  = color_all (&live, il, initial, spill_temps);
 
-  int try = 0;
-  while (++try < 7)
+  // Temps that disappeared from the liveness sets
+  tab_table *dead = tab_new_table ();
+
+  while (col.spills != NULL)
     {
-      flow = fgraph_assem_flow_graph (il, f);
-      //graph_show (stdout, graph_nodes(flow), print_inst);
-      live = live_liveness (flow);
-      //graph_show (stdout, graph_nodes(live.graph), print_temp);
-      initial = frm_initial_registers (f);
-      col = col_color (live.graph, initial, frm_registers (),
-                       live.worklist_moves, live.move_list, live.spill_cost);
-
-    if (col.spills == NULL)
+      temp_temp_list *tl;
+      graph_node_list *nl;
+
+    temp_temp_list *spilled = union_temp (col.spills, NULL);
+
+    // Split the live ranges of temps that were not split before, the
+    // pieces may get registers in the next round
+    temp_temp_list *unsplit = NULL;
+    if (split)
+      unsplit = temp_minus (temp_minus (spilled, spill_temps), split_temps);
+    if (unsplit != NULL)
       {
-        break;
+        tab_table *group = tab_new_table ();
+        for (nl = graph_nodes (live.graph); nl; nl = nl->tail)
+          {
+            graph_node *alias = get_alias (nl->head, col.alias,
+                                           col.coalesced_nodes);
+            if (temp_in (node_to_temp (alias), unsplit))
+              tab_bind_value (group, live_gtemp (nl->head),
+                              node_to_temp (alias));
+          }
+
+        split_temps = union_temp (split_temps, unsplit);
+        if (spl_split_live_ranges (&il, unsplit, group, live.live_out,
+                                   &split_temps))
+          {
+            live = live_liveness (fgraph_block_graph (il));
+            col  = color_all (&live, il, initial, spill_temps);
+            dead = tab_new_table ();
+            continue;
+          }
       }
 
-    temp_temp_list *spilled = col.spills;
+    temp_temp_list *stuck   = intersect_temp (spill_temps, spilled);
+    if (stuck != NULL)
+      {
+        spilled = temp_minus (spilled, stuck);
+        for (tl = stuck; tl; tl = tl->tail)
+          spilled = union_temp (spilled,
+                                spillable_neighbors (tl->head, live.graph,
+                                                     col.alias,
+                                                     col.coalesced_nodes,
+                                                     initial, spill_temps));
+        if (spilled == NULL)
+          {
+            temp_temp *t = spill_elsewhere (stuck, live.graph, col.alias,
+                                            col.coalesced_nodes, initial,
+                                            spill_temps, live.spill_cost);
+            // Once every temp of the program is spilled, each one lives
+            // only inside of one instruction and none needs more than K
+            // registers, so the coloring cannot get stuck any more
+            if (t == NULL)
+              errm_impossible ("fail to allocate registers");
+            spilled = temp_new_temp_list (t, NULL);
+          }
+      }
     rewrite_list = NULL;
 
-    // Assign locals in memory
-    temp_temp_list *tl;
+    // Assign locals in memory, rematerialized temps need no slot
+    tab_table *remat = find_remat (il, live.graph, col.alias,
+                                   col.coalesced_nodes);
     tab_table *spilled_local = tab_new_table ();
     for (tl = spilled; tl; tl = tl->tail)
       {
+        if (tab_lookup (remat, tl->head) != NULL)
+          continue;
         frm_access *local = frm_alloc_local (f, true);
         tab_bind_value (spilled_local, tl->head, local);
       }
 
-    // Rewrite instructions
+    // The spilled temps with the temps coalesced into them disappear
+    temp_temp_list *removed = NULL;
+    for (nl = graph_nodes (live.graph); nl; nl = nl->tail)
+      {
+        graph_node *alias = get_alias (nl->head, col.alias,
+                                       col.coalesced_nodes);
+        if (temp_in (node_to_temp (alias), spilled))
+          removed = temp_new_temp_list (live_gtemp (nl->head), removed);
+      }
+    for (tl = removed; tl; tl = tl->tail)
+      tab_bind_value (dead, tl->head, tl->head);
+
+    // Only the sets of rewritten instructions lose these temps, the sets
+    // of the others are stripped when they get rewritten in a later round
+    assem_instr_list *changed   = NULL;
+    temp_temp_list   *new_temps = NULL;
+
+    // Rewrite instructions, every occurrence of a spilled temp gets a new
+    // temp with a tiny live range
     for (; il; il = il->tail)
       {
         assem_instr *inst = il->head;
-        temp_temp_list *use_spilled = intersect_temp (aliased(inst_use(inst),
-                                                              live.graph,
-                                                              col.alias,
-                                                              col.coalesced_nodes),
-                                                      spilled);
-        temp_temp_list *def_spilled = intersect_temp (aliased(inst_def(inst),
-                                                              live.graph,
-                                                              col.alias,
-                                                              col.coalesced_nodes),
-                                                      spilled);
+        if (inst->kind == I_LABEL)
+          {
+            rewrite_list = assem_new_instr_list (inst, rewrite_list);
+            continue;
+          }
+
+        void *depth = tab_lookup (live.depth, inst);
+        temp_temp_list *use_spilled =
+          intersect_temp (aliased (fgraph_inst_use (inst), live.graph,
+                                   col.alias, col.coalesced_nodes),
+                          spilled);
+        temp_temp_list *def_spilled =
+          intersect_temp (aliased (fgraph_inst_def (inst), live.graph,
+                                   col.alias, col.coalesced_nodes),
+                          spilled);
         temp_temp_list *temp_spilled = union_temp (use_spilled, def_spilled);
 
       // Skip unspilled instructions
@@ -231,49 +737,108 @@ regalloc_do (frm_frame        *f,
           continue;
         }
 
+      temp_temp_list *out = strip_temps (tab_lookup (live.live_out, inst),
+                                         dead);
+
+      // The value gets recomputed at every use
+      if (is_const_load (inst) && def_spilled != NULL
+          && tab_lookup (remat, def_spilled->head) != NULL)
+        continue;
+
+      // Use the frame slot as operand if the instruction allows it
+      for (tl = temp_spilled; tl; tl = tl->tail)
+        {
+          frm_access *local = tab_lookup (spilled_local, tl->head);
+          if (local != NULL
+              && fold_spill (inst, tl->head, frm_access_offset (local),
+                             live.graph, col.alias, col.coalesced_nodes))
+            {
+              temp_temp_list *folded = temp_new_temp_list (tl->head, NULL);
+              use_spilled = temp_minus (use_spilled, folded);
+              def_spilled = temp_minus (def_spilled, folded);
+              break;
+            }
+        }
+
+      tab_table *fresh = tab_new_table ();
+      temp_temp_list *use = rewrite_temps (fgraph_inst_use (inst), live.graph,
+                                           col.alias, col.coalesced_nodes,
+                                           spilled, fresh, &new_temps);
+      temp_temp_list *def = rewrite_temps (fgraph_inst_def (inst), live.graph,
+                                           col.alias, col.coalesced_nodes,
+                                           spilled, fresh, &new_temps);
+      fgraph_set_temps (inst, use, def);
+
+      // Both lists are in reverse order
+      assem_instr_list *loads = NULL, *stores = NULL, *al;
+
       for (tl = use_spilled; tl; tl = tl->tail)
         {
-          char buf[128];
-          temp_temp *temp = tl->head;
-          frm_access *local = (frm_access*)tab_lookup (spilled_local, temp);
-          sprintf(buf, "movl %d(`s0), `d0  # spilled\n",
-                  frm_access_offset (local));
-          rewrite_list = assem_new_instr_list (assem_new_oper (string_new (buf),
-                                                       temp_new_temp_list (temp,
-                                                                      NULL),
-                                                       temp_new_temp_list (frm_fp (),
-                                                                      NULL),
-                                                       NULL),
-                                       rewrite_list);
+          temp_temp *temp = tab_lookup (fresh, tl->head);
+          assem_instr *def = tab_lookup (remat, tl->head);
+          if (def != NULL)
+            {
+              loads = assem_new_instr_list (assem_new_oper (def->u.oper.assem,
+                                                            temp_new_temp_list (temp,
+                                                                                NULL),
+                                                            NULL,
+                                                            NULL),
+                                            loads);
+              continue;
+            }
+          frm_access *local = (frm_access*)tab_lookup (spilled_local, tl->head);
+          int offset = frm_access_offset (local);
+          loads = assem_new_instr_list (fgraph_spill_load (temp, offset),
+                                        loads);
       }
 
-      rewrite_list = assem_new_instr_list (inst, rewrite_list);
-
       for (tl = def_spilled; tl; tl = tl->tail)
         {
-          char buf[128];
-          temp_temp *temp = tl->head;
-          frm_access *local = (frm_access*)tab_lookup (spilled_local, temp);
-          sprintf(buf, "movl `s0, %d(`s1)  # spilled\n",
-                  frm_access_offset (local));
-          rewrite_list = assem_new_instr_list (assem_new_oper (string_new (buf),
-                                                       NULL,
-                                                       temp_new_temp_list (temp,
-                                                                      temp_new_temp_list (frm_fp(),
-                                                                                          NULL)),
-                                                       NULL),
-                                       rewrite_list);
+          temp_temp *temp = tab_lookup (fresh, tl->head);
+          if (tab_lookup (remat, tl->head) != NULL)
+            continue;
+          frm_access *local = (frm_access*)tab_lookup (spilled_local, tl->head);
+          int offset = frm_access_offset (local);
+          stores = assem_new_instr_list (fgraph_spill_store (temp, offset),
+                                         stores);
       }
+
+      // Patch the liveness sets, from the last store up to the first load
+      for (al = stores; al; al = al->tail)
+        {
+          tab_bind_value (live.live_out, al->head, out);
+          tab_bind_value (live.depth, al->head, depth);
+          out = live_in (al->head, out);
+        }
+      tab_bind_value (live.live_out, inst, out);
+      out = live_in (inst, out);
+      for (al = loads; al; al = al->tail)
+        {
+          tab_bind_value (live.live_out, al->head, out);
+          tab_bind_value (live.depth, al->head, depth);
+          out = live_in (al->head, out);
+        }
+
+      for (al = reverse_instr_list (loads); al; al = al->tail)
+        rewrite_list = assem_new_instr_list (al->head, rewrite_list);
+      rewrite_list = assem_new_instr_list (inst, rewrite_list);
+      for (al = reverse_instr_list (stores); al; al = al->tail)
+        rewrite_list = assem_new_instr_list (al->head, rewrite_list);
+      changed = assem_new_instr_list (inst, changed);
+      for (al = loads; al; al = al->tail)
+        changed = assem_new_instr_list (al->head, changed);
+      for (al = stores; al; al = al->tail)
+        changed = assem_new_instr_list (al->head, changed);
     }
 
     il = reverse_instr_list (rewrite_list);
+    live_update (&live, removed, changed);
+    for (tl = new_temps; tl; tl = tl->tail)
+      temp_enter_ptr (live.spill_cost, tl->head, (void*)SPILL_TEMP_COST);
+    spill_temps = union_temp (spill_temps, new_temps);
+    col = col_recolor (live.worklist_moves, removed);
   }
 
-  if (col.spills != NULL)
-    {
-      errm_printf (0, "fail to allocate registers");
-    }
-
   if (col.coalesced_moves != NULL)
     {
       rewrite_list = NULL;
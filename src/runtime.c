@@ -4,84 +4,707 @@
  */
 
 //#undef __STDC__
+#include <cpuid.h>
+#include <immintrin.h>
+#include <limits.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 extern int tigermain (int);
 
+static void in_init (void);
+
+static void runtime_error (const char *format,
+                           ...);
+
+static void (*fill) (int *a,
+                     int  n,
+                     int  value);
+
+/*
+  Heap profile. With --heap-profile the compiled code stores the site of an
+  allocation, line << 10 | column, in heapSite before calling into the
+  runtime. The bytes and allocations of every site are summed up in an open
+  addressed table and reported to stderr at exit, most bytes first.
+*/
+#define HEAP_SITES 4096
+
+struct heap_site
+{
+  int           site;
+  unsigned long count;
+  unsigned long bytes;
+};
+
+int heapSite;
+
+static struct heap_site heap_sites[HEAP_SITES];
+static int              heap_used;
+
+static void
+heap_count (int bytes)
+{
+  unsigned int      h = (unsigned int)heapSite * 2654435761u % HEAP_SITES;
+  struct heap_site *s;
+  if (heapSite == 0)
+    return;
+  while (heap_sites[h].site != heapSite && heap_sites[h].site != 0)
+    h = (h + 1) % HEAP_SITES;
+  s = &heap_sites[h];
+  if (s->site == 0)
+    {
+      if (heap_used == HEAP_SITES - 1)
+        return; /* keep one slot empty to end the search */
+      s->site = heapSite;
+      heap_used++;
+    }
+  s->count++;
+  s->bytes += bytes;
+}
+
+static int
+heap_cmp (const void *a,
+          const void *b)
+{
+  const struct heap_site *x = a, *y = b;
+  if (x->bytes != y->bytes)
+    return x->bytes < y->bytes ? 1 : -1;
+  return x->site - y->site;
+}
+
+static void
+heap_report (void)
+{
+  int i, n = 0;
+  if (heap_used == 0)
+    return;
+  for (i = 0; i < HEAP_SITES; i++)
+    if (heap_sites[i].site != 0)
+      heap_sites[n++] = heap_sites[i];
+  qsort (heap_sites, n, sizeof(heap_sites[0]), heap_cmp);
+  fprintf (stderr, "      bytes      allocs  site\n");
+  for (i = 0; i < n; i++)
+    fprintf (stderr, "%11lu %11lu  %d.%d\n", heap_sites[i].bytes,
+             heap_sites[i].count, heap_sites[i].site >> 10,
+             heap_sites[i].site & 1023);
+}
+
+/*
+  Execution counts of a program compiled with --instrument. The compiler
+  emits the counters with their names, without it the weak symbols stay
+  0. At exit every counter is written with its name to tigerprof.out or
+  the file named by TIGER_PROFILE.
+*/
+extern int   tigercountsize    __attribute__ ((weak));
+extern int   tigercounters[]   __attribute__ ((weak));
+extern char *tigercountnames[] __attribute__ ((weak));
+
+static void
+write_profile (void)
+{
+  int   i;
+  char *name = getenv ("TIGER_PROFILE");
+  FILE *f;
+  if (&tigercountsize == NULL)
+    return;
+  f = fopen (name != NULL ? name : "tigerprof.out", "w");
+  if (f == NULL)
+    return;
+  for (i = 0; i < tigercountsize; i++)
+    fprintf (f, "%11d %s\n", tigercounters[i], tigercountnames[i]);
+  fclose (f);
+}
+
+/*
+  Pool allocator for the small objects of a program: records, arrays,
+  strings and their builders. A size up to POOL_MAX bytes is rounded up to
+  its size class, a multiple of POOL_ALIGN, and taken from the free list of
+  the class or bumped from the current chunk. poolFree() puts an object
+  back on its free list, so a collector can reuse the memory, without one
+  nothing gets freed. Larger sizes go to malloc. With TIGER_ALLOC_STATS set
+  in the environment the allocator prints its statistics at exit.
+*/
+#define POOL_ALIGN   4
+#define POOL_MAX     256
+#define POOL_CLASSES (POOL_MAX / POOL_ALIGN + 1)
+#define POOL_CHUNK   (64 * 1024)
+
+struct pool_obj
+{
+  struct pool_obj *next;
+};
+
+static struct pool_obj *pool_free[POOL_CLASSES];
+static char            *pool_next;
+static char            *pool_end;
+
+static unsigned long pool_allocs[POOL_CLASSES];
+static unsigned long pool_frees[POOL_CLASSES];
+static unsigned long pool_chunks;
+static unsigned long pool_large;
+static unsigned long pool_large_bytes;
+
+static int
+pool_class (int size)
+{
+  if (size < (int)sizeof(struct pool_obj))
+    size = sizeof(struct pool_obj);
+  return (size + POOL_ALIGN - 1) / POOL_ALIGN;
+}
+
+void *
+poolAlloc (int size)
+{
+  int   c, bytes;
+  void *p;
+  heap_count (size);
+  if (size > POOL_MAX)
+    {
+      pool_large++;
+      pool_large_bytes += size;
+      p = malloc (size);
+      if (p == NULL)
+        runtime_error ("out of memory\n");
+      return p;
+    }
+  c = pool_class (size);
+  pool_allocs[c]++;
+  if (pool_free[c] != NULL)
+    {
+      p = pool_free[c];
+      pool_free[c] = pool_free[c]->next;
+      return p;
+    }
+  bytes = c * POOL_ALIGN;
+  if (pool_end - pool_next < bytes)
+    {
+      /* The rest of the old chunk is lost, it is less than POOL_MAX */
+      pool_next = (char *)malloc (POOL_CHUNK);
+      if (pool_next == NULL)
+        runtime_error ("out of memory\n");
+      pool_end  = pool_next + POOL_CHUNK;
+      pool_chunks++;
+    }
+  p = pool_next;
+  pool_next += bytes;
+  return p;
+}
+
+void
+poolFree (void *p,
+          int   size)
+{
+  int              c;
+  struct pool_obj *o = (struct pool_obj *)p;
+  if (size > POOL_MAX)
+    {
+      free (p);
+      return;
+    }
+  c = pool_class (size);
+  pool_frees[c]++;
+  o->next      = pool_free[c];
+  pool_free[c] = o;
+}
+
+static void
+pool_print_stats (void)
+{
+  int           c;
+  unsigned long allocs = 0, bytes = 0;
+  fprintf (stderr, "size class      allocs       frees\n");
+  for (c = 0; c < POOL_CLASSES; c++)
+    if (pool_allocs[c] > 0)
+      {
+        fprintf (stderr, "%10d %11lu %11lu\n",
+                 c * POOL_ALIGN, pool_allocs[c], pool_frees[c]);
+        allocs += pool_allocs[c];
+        bytes  += pool_allocs[c] * c * POOL_ALIGN;
+      }
+  fprintf (stderr, "small: %lu allocs, %lu bytes in %lu chunks of %d\n",
+           allocs, bytes, pool_chunks, POOL_CHUNK);
+  fprintf (stderr, "large: %lu allocs, %lu bytes\n",
+           pool_large, pool_large_bytes);
+}
+
+/*
+  The length of an array is stored one word in front of its first element,
+  the compiler checks subscripts against it with --bounds-check. Small
+  arrays come from the pool. Larger arrays of zeros come from calloc, which
+  gets large blocks as zeroed pages from the system and does not touch them
+  again.
+*/
 int *
 initArray (int size,
            int init)
 {
-  int i;
-  int *a = (int *)malloc (size*sizeof(int));
-  for (i = 0;i < size; i++)
-    a[i]=init;
+  int *a;
+  int  bytes;
+  if (size < 0 || size > INT_MAX / (int)sizeof(int) - 1)
+    runtime_error ("array of size %d\n", size);
+  bytes = (size + 1)*sizeof(int);
+  if (bytes <= POOL_MAX)
+    {
+      a = (int *)poolAlloc (bytes);
+      fill (a + 1, size, init);
+    }
+  else
+    {
+      pool_large++;
+      pool_large_bytes += bytes;
+      heap_count (bytes);
+      if (init == 0)
+        a = (int *)calloc (size + 1, sizeof(int));
+      else
+        a = (int *)malloc (bytes);
+      if (a == NULL)
+        runtime_error ("out of memory\n");
+      if (init != 0)
+        fill (a + 1, size, init);
+    }
+  *(a++) = size;
   return a;
 }
 
+void
+subscriptError (int index,
+                int length)
+{
+  runtime_error ("subscript [%d] out of range [0,%d)\n", index, length);
+}
+
 int *
 allocRecord (int size)
 {
-  int i;
-  int *p, *a;
-  p = a = (int *)malloc(size);
-  for(i = 0; i<size; i += sizeof(int))
-    *p++ = 0;
- return a;
+  int *r = (int *)poolAlloc (size);
+  memset (r, 0, size);
+  return r;
+}
+
+/*
+  Record without initialized fields, the compiler uses it when the record
+  expression sets every field anyway.
+*/
+int *
+allocRecordUninit (int size)
+{
+  return (int *)poolAlloc (size);
 }
 
+/*
+  The compiler emits string literals with this layout. hash is 0 until
+  hash_of() computed it.
+*/
 struct
 string
 {
   int           length;
+  int           hash;
   unsigned char chars[1];
 };
 
+/*
+  Strings made by concat are slices of a builder, the first length bytes of
+  its buffer. A concat to the newest slice of a builder appends in place and
+  the buffer doubles when it is full, so building a string in a loop copies
+  every byte only a constant number of times. A slice has SLICE where a flat
+  string has its length, literals and the strings of chr and substring stay
+  flat.
+*/
+#define SLICE (-1)
+
+struct
+builder
+{
+  int            length;
+  int            capacity;
+  unsigned char *chars;
+};
+
+struct
+slice
+{
+  int             tag;
+  int             hash;
+  int             length;
+  struct builder *builder;
+};
+
+static int
+length_of (struct string *s)
+{
+  if (s->length == SLICE)
+    return ((struct slice *)s)->length;
+  return s->length;
+}
+
+static unsigned char *
+chars_of (struct string *s)
+{
+  if (s->length == SLICE)
+    return ((struct slice *)s)->builder->chars;
+  return s->chars;
+}
+
+/*
+  The old buffer is not freed when the builder grows, older slices and
+  the string being appended can still point into it.
+*/
+static void
+append (struct builder *b,
+        unsigned char  *chars,
+        int             n)
+{
+  if (b->length + n > b->capacity)
+    {
+      int            capacity = 2 * (b->length + n);
+      unsigned char *buf;
+      if (capacity < 16)
+        capacity = 16;
+      buf = (unsigned char *)poolAlloc (capacity);
+      if (b->length > 0)
+        memcpy (buf, b->chars, b->length);
+      b->chars    = buf;
+      b->capacity = capacity;
+    }
+  memcpy (b->chars + b->length, chars, n);
+  b->length += n;
+}
+
+static struct builder *
+new_builder (void)
+{
+  struct builder *b = (struct builder *)poolAlloc (sizeof(*b));
+  b->length   = 0;
+  b->capacity = 0;
+  b->chars    = NULL;
+  return b;
+}
+
+/* Returns the whole content of b as a string */
+static struct string *
+new_slice (struct builder *b)
+{
+  struct slice *t = (struct slice *)poolAlloc (sizeof(*t));
+  t->tag     = SLICE;
+  t->hash    = 0;
+  t->length  = b->length;
+  t->builder = b;
+  return (struct string *)t;
+}
+
+/*
+  Byte comparison, picked by init_simd() from what the CPU supports.
+  Returns the index of the first byte where a and b differ, n if the
+  first n bytes are equal.
+*/
+static int (*mismatch) (const unsigned char *a,
+                        const unsigned char *b,
+                        int                  n);
+
+static int
+mismatch_scalar (const unsigned char *a,
+                 const unsigned char *b,
+                 int                  n)
+{
+  int i;
+  for (i = 0; i < n; i++)
+    if (a[i] != b[i])
+      return i;
+  return n;
+}
+
+__attribute__ ((target ("sse2")))
+static int
+mismatch_sse2 (const unsigned char *a,
+               const unsigned char *b,
+               int                  n)
+{
+  int i;
+  for (i = 0; i + 16 <= n; i += 16)
+    {
+      __m128i x = _mm_loadu_si128 ((const __m128i *)(a + i));
+      __m128i y = _mm_loadu_si128 ((const __m128i *)(b + i));
+      unsigned int equal = _mm_movemask_epi8 (_mm_cmpeq_epi8 (x, y));
+      if (equal != 0xffff)
+        return i + __builtin_ctz (~equal);
+    }
+  return i + mismatch_scalar (a + i, b + i, n - i);
+}
+
+__attribute__ ((target ("avx2")))
+static int
+mismatch_avx2 (const unsigned char *a,
+               const unsigned char *b,
+               int                  n)
+{
+  int i;
+  for (i = 0; i + 32 <= n; i += 32)
+    {
+      __m256i x = _mm256_loadu_si256 ((const __m256i *)(a + i));
+      __m256i y = _mm256_loadu_si256 ((const __m256i *)(b + i));
+      unsigned int equal = _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (x, y));
+      if (equal != 0xffffffff)
+        return i + __builtin_ctz (~equal);
+    }
+  return i + mismatch_sse2 (a + i, b + i, n - i);
+}
+
+/*
+  Word fill of arrays, picked by init_simd() like mismatch.
+*/
+static void
+fill_scalar (int *a,
+             int  n,
+             int  value)
+{
+  int i;
+  for (i = 0; i < n; i++)
+    a[i] = value;
+}
+
+__attribute__ ((target ("sse2")))
+static void
+fill_sse2 (int *a,
+           int  n,
+           int  value)
+{
+  int     i;
+  __m128i v = _mm_set1_epi32 (value);
+  for (i = 0; i + 4 <= n; i += 4)
+    _mm_storeu_si128 ((__m128i *)(a + i), v);
+  fill_scalar (a + i, n - i, value);
+}
+
+__attribute__ ((target ("avx2")))
+static void
+fill_avx2 (int *a,
+           int  n,
+           int  value)
+{
+  int     i;
+  __m256i v = _mm256_set1_epi32 (value);
+  for (i = 0; i + 8 <= n; i += 8)
+    _mm256_storeu_si256 ((__m256i *)(a + i), v);
+  fill_sse2 (a + i, n - i, value);
+}
+
+static void
+init_simd (void)
+{
+  unsigned int a, b, c, d, xcr0_lo, xcr0_hi;
+
+  mismatch = mismatch_scalar;
+  fill     = fill_scalar;
+  if (!__get_cpuid (1, &a, &b, &c, &d))
+    return;
+  if (d & bit_SSE2)
+    {
+      mismatch = mismatch_sse2;
+      fill     = fill_sse2;
+    }
+
+  /* AVX2 also needs the OS to save the ymm registers */
+  if (!(c & bit_OSXSAVE))
+    return;
+  __asm__ ("xgetbv" : "=a" (xcr0_lo), "=d" (xcr0_hi) : "c" (0));
+  if ((xcr0_lo & 6) != 6)
+    return;
+  if (__get_cpuid_count (7, 0, &a, &b, &c, &d) && (b & bit_AVX2))
+    {
+      mismatch = mismatch_avx2;
+      fill     = fill_avx2;
+    }
+}
+
+/*
+  FNV-1a over words, cached in the string. Strings do not change, so the
+  hash stays valid. 0 is kept for not computed.
+*/
+static unsigned int
+hash_of (struct string *s)
+{
+  int            i, n  = length_of (s);
+  unsigned char *chars = chars_of (s);
+  unsigned int   h     = 2166136261u, w;
+
+  if (s->hash != 0)
+    return s->hash;
+
+  for (i = 0; i + 4 <= n; i += 4)
+    {
+      memcpy (&w, chars + i, 4);
+      h = (h ^ w) * 16777619u;
+    }
+  for (; i < n; i++)
+    h = (h ^ chars[i]) * 16777619u;
+
+  if (h == 0)
+    h = 1;
+  s->hash = h;
+  return h;
+}
+
+/* Strings from this length on get compared by their hashes first */
+#define HASH_MIN_LENGTH 64
+
 int
 stringEqual (struct string *s,
              struct string *t)
 {
-  int i;
+  int n = length_of (s);
+  unsigned char *sc, *tc;
   if (s==t)
     return 1;
-  if (s->length != t->length)
+  if (n != length_of (t))
     return 0;
-  for(i = 0; i < s->length; i++)
-    if (s->chars[i] != t->chars[i])
-      return 0;
-  return 1;
+  sc = chars_of (s);
+  tc = chars_of (t);
+  if (n >= HASH_MIN_LENGTH)
+    {
+      /* Most unequal strings differ early, only hash the others */
+      if (mismatch (sc, tc, HASH_MIN_LENGTH) != HASH_MIN_LENGTH)
+        return 0;
+      if (hash_of (s) != hash_of (t))
+        return 0;
+    }
+  return mismatch (sc, tc, n) == n;
+}
+
+/*
+  Orders strings by their bytes, a prefix comes first. Returns a negative
+  number, zero or a positive number if s is less than, equal to or greater
+  than t.
+*/
+int
+stringCompare (struct string *s,
+               struct string *t)
+{
+  int            ns = length_of (s), nt = length_of (t);
+  int            n  = ns < nt ? ns : nt, i;
+  unsigned char *sc, *tc;
+  if (s==t)
+    return 0;
+  sc = chars_of (s);
+  tc = chars_of (t);
+  i = mismatch (sc, tc, n);
+  if (i < n)
+    return sc[i] - tc[i];
+  return ns - nt;
+}
+
+/*
+  print and printi collect their output here. It goes out with one write
+  when the buffer is full, on flush and at exit. When stdout is a terminal
+  it also goes out before reading input, so prompts show up.
+*/
+#define OUT_SIZE (64 * 1024)
+
+static unsigned char out_buf[OUT_SIZE];
+static int           out_len;
+static int           out_tty;
+
+static void
+write_all (const unsigned char *p,
+           int                  n)
+{
+  while (n > 0)
+    {
+      int done = write (STDOUT_FILENO, p, n);
+      if (done <= 0)
+        return;
+      p += done;
+      n -= done;
+    }
+}
+
+static void
+out_flush (void)
+{
+  write_all (out_buf, out_len);
+  out_len = 0;
+}
+
+static void
+out_write (const unsigned char *p,
+           int                  n)
+{
+  if (out_len + n > OUT_SIZE)
+    {
+      out_flush ();
+      if (n >= OUT_SIZE)
+        {
+          write_all (p, n);
+          return;
+        }
+    }
+  memcpy (out_buf + out_len, p, n);
+  out_len += n;
+}
+
+/*
+  Prints a message after the buffered output and exits with 1. stdout is
+  line buffered on a terminal, so the buffer has to go out first.
+*/
+static void
+runtime_error (const char *format,
+               ...)
+{
+  va_list ap;
+  out_flush ();
+  va_start (ap, format);
+  vfprintf (stdout, format, ap);
+  va_end (ap);
+  exit (1);
 }
 
 void
 print (struct string *s)
 {
-  int            i;
-  unsigned char *p = s->chars;
-  for (i = 0; i < s->length; i++, p++)
-    putchar (*p);
+  out_write (chars_of (s), length_of (s));
 }
 
 void
 printi (int k)
 {
-	printf("%d", k);
+  unsigned char  buf[12];
+  unsigned char *p = buf + sizeof(buf);
+  unsigned int   u = k < 0 ? -(unsigned int)k : (unsigned int)k;
+  do
+    *--p = '0' + u % 10;
+  while (u /= 10);
+  if (k < 0)
+    *--p = '-';
+  out_write (p, buf + sizeof(buf) - p);
 }
 
 void
 flush ()
 {
+  out_flush ();
   fflush(stdout);
 }
 
 struct string consts[256];
-struct string empty = {0,""};
+struct string empty = {0,0,""};
 
 int
 main()
 {
   int i;
+  init_simd ();
+  out_tty = isatty (STDOUT_FILENO);
+  atexit (out_flush);
+  if (getenv ("TIGER_ALLOC_STATS") != NULL)
+    atexit (pool_print_stats);
+  atexit (heap_report);
+  atexit (write_profile);
+  in_init ();
   for (i=0; i<256; i++)
    {
      consts[i].length = 1;
@@ -93,10 +716,10 @@ main()
 int
 ord (struct string *s)
 {
-  if (s->length==0)
+  if (length_of (s)==0)
     return -1;
   else
-    return s->chars[0];
+    return chars_of (s)[0];
 }
 
 struct string *
@@ -104,8 +727,7 @@ chr (int i)
 {
   if (i<0 || i>=256)
     {
-      printf ("chr(%d) out of range\n", i);
-      exit(1);
+      runtime_error ("chr(%d) out of range\n", i);
     }
  return consts + i;
 }
@@ -113,7 +735,7 @@ chr (int i)
 int
 size (struct string *s)
 {
-  return s->length;
+  return length_of (s);
 }
 
 struct string *
@@ -121,19 +743,20 @@ substring (struct string *s,
            int            first,
            int            n)
 {
-  if (first < 0 || first+n > s->length)
+  int            length = length_of (s);
+  unsigned char *chars  = chars_of (s);
+  if (first < 0 || first+n > length)
     {
-      printf ("substring([%d],%d,%d) out of range\n", s->length,first,n);
-      exit (1);
+      runtime_error ("substring([%d],%d,%d) out of range\n",
+                     length, first, n);
     }
  if (n == 1)
-   return consts + s->chars[first];
+   return consts + chars[first];
  {
-   struct string *t = (struct string *)malloc (sizeof(int) + n);
-   int i;
+   struct string *t = (struct string *)poolAlloc (2 * sizeof(int) + n);
    t->length=n;
-   for (i = 0;i < n;i++)
-     t->chars[i] = s->chars[first + i];
+   t->hash=0;
+   memcpy (t->chars, chars + first, n);
    return t;
  }
 }
@@ -142,20 +765,23 @@ struct string *
 concat (struct string *a,
         struct string *b)
 {
-  if (a->length == 0)
+  int la = length_of (a), lb = length_of (b);
+  if (la == 0)
     return b;
-  else if (b->length == 0)
+  else if (lb == 0)
     return a;
   else
     {
-      int i, n = a->length+b->length;
-      struct string *t = (struct string *)malloc (sizeof(int)+n);
-      t->length=n;
-      for (i =0; i < a->length; i++)
-        t->chars[i]=a->chars[i];
-      for(i=0; i < b->length; i++)
-        t->chars[i + a->length] = b->chars[i];
-      return t;
+      struct builder *bu;
+      if (a->length == SLICE && ((struct slice *)a)->builder->length == la)
+        bu = ((struct slice *)a)->builder; /* a is the newest slice */
+      else
+        {
+          bu = new_builder ();
+          append (bu, chars_of (a), la);
+        }
+      append (bu, chars_of (b), lb);
+      return new_slice (bu);
     }
 }
 
@@ -167,12 +793,154 @@ not (int i)
 
 #undef getchar
 
+/*
+  getchar and the read functions take their input from here. A regular
+  file on stdin gets mapped as a whole and readline and readall return
+  strings that point into the mapping. Other input is read in blocks.
+*/
+#define IN_SIZE (64 * 1024)
+
+static unsigned char  in_block[IN_SIZE];
+static unsigned char *in_buf = in_block;
+static int            in_pos;
+static int            in_len;
+static int            in_mapped;
+
+static void
+in_init (void)
+{
+  struct stat st;
+  off_t       pos;
+  void       *p;
+
+  if (fstat (STDIN_FILENO, &st) != 0 || !S_ISREG (st.st_mode)
+      || st.st_size <= 0 || st.st_size != (int)st.st_size)
+    return;
+  pos = lseek (STDIN_FILENO, 0, SEEK_CUR);
+  if (pos < 0)
+    return;
+  p = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, STDIN_FILENO, 0);
+  if (p == MAP_FAILED)
+    return;
+  in_buf    = (unsigned char *)p;
+  in_pos    = pos < st.st_size ? pos : st.st_size;
+  in_len    = st.st_size;
+  in_mapped = 1;
+}
+
+/* Makes input available at in_pos, returns 0 at the end of the input */
+static int
+in_fill (void)
+{
+  int n;
+  if (in_pos < in_len)
+    return 1;
+  if (in_mapped)
+    return 0;
+  if (out_tty)
+    out_flush ();
+  n = read (STDIN_FILENO, in_block, IN_SIZE);
+  if (n <= 0)
+    return 0;
+  in_pos = 0;
+  in_len = n;
+  return 1;
+}
+
+/* Makes a string of n bytes of input, without copying them if mapped */
+static struct string *
+in_string (unsigned char *chars,
+           int            n)
+{
+  if (n == 1)
+    return consts + chars[0];
+  if (in_mapped)
+    {
+      struct builder *b = new_builder ();
+      b->chars    = chars;
+      b->length   = n;
+      b->capacity = n; /* a concat copies before appending */
+      return new_slice (b);
+    }
+  else
+    {
+      struct string *t = (struct string *)poolAlloc (2 * sizeof(int) + n);
+      t->length = n;
+      t->hash   = 0;
+      memcpy (t->chars, chars, n);
+      return t;
+    }
+}
+
 struct string *
 __wrap_getchar ()
 {
-  int i = getc(stdin);
-  if (i == EOF)
+  if (!in_fill ())
     return &empty;
-  else
-    return consts + i;
+  return consts + in_buf[in_pos++];
+}
+
+/*
+  Returns the next line with its newline, the empty string at the end of
+  the input.
+*/
+struct string *
+readline ()
+{
+  struct builder *b = NULL;
+  while (in_fill ())
+    {
+      unsigned char *start = in_buf + in_pos;
+      unsigned char *nl    = memchr (start, '\n', in_len - in_pos);
+      int            n     = nl ? nl + 1 - start : in_len - in_pos;
+      in_pos += n;
+      if (b == NULL && (nl || in_mapped))
+        return in_string (start, n);
+      if (b == NULL)
+        b = new_builder ();
+      append (b, start, n);
+      if (nl)
+        break;
+    }
+  return b ? new_slice (b) : &empty;
+}
+
+/* Returns the rest of the input */
+struct string *
+readall ()
+{
+  struct builder *b = NULL;
+  if (in_mapped && in_fill ())
+    {
+      unsigned char *start = in_buf + in_pos;
+      in_pos = in_len;
+      return in_string (start, in_len - (start - in_buf));
+    }
+  while (in_fill ())
+    {
+      if (b == NULL)
+        b = new_builder ();
+      append (b, in_buf + in_pos, in_len - in_pos);
+      in_pos = in_len;
+    }
+  return b ? new_slice (b) : &empty;
+}
+
+/*
+  Skips white space and reads a decimal number with an optional sign.
+  Returns 0 if there is no number, the input after it is left unread.
+*/
+int
+readint ()
+{
+  unsigned int v   = 0;
+  int          neg = 0;
+  while (in_fill () && (in_buf[in_pos] == ' ' || in_buf[in_pos] == '\t'
+                        || in_buf[in_pos] == '\n' || in_buf[in_pos] == '\r'))
+    in_pos++;
+  if (in_fill () && (in_buf[in_pos] == '-' || in_buf[in_pos] == '+'))
+    neg = in_buf[in_pos++] == '-';
+  while (in_fill () && in_buf[in_pos] >= '0' && in_buf[in_pos] <= '9')
+    v = v * 10 + (in_buf[in_pos++] - '0');
+  return neg ? (int)(0u - v) : (int)v;
 }
@@ -18,6 +18,11 @@
 #include "include/absyn.h"
 #include "include/env.h"
 #include "include/escape.h"
+#include "include/recescape.h"
+#include "include/bounds.h"
+#include "include/instrument.h"
+#include "include/inline.h"
+#include "include/table.h"
 
 typedef struct _bool_list bool_list;
 typedef struct _expty     expty;
@@ -26,6 +31,10 @@ typedef struct _expty     expty;
 
 bool_list *loop_status = NULL; /* List to keep track of loop status */
 
+static tab_table *inline_candidates = NULL; /* Function entry to candidate */
+
+static tab_table *tail_calls = NULL; /* Call expressions in tail position */
+
 /**
  * Struct to store translated expression with type information.
  */
@@ -77,6 +86,8 @@ static void            process_func_body     (sym_table  *venv_ptr,
                                               absyn_dec  *dec_ptr,
                                               temp_label *break_done);
 
+static void            find_tail_calls       (absyn_exp  *exp_ptr);
+
 static void            process_type_header   (sym_table  *tenv_ptr,
                                               absyn_dec  *dec_ptr);
 
@@ -86,12 +97,34 @@ static void            process_type_body     (sym_table  *tenv_ptr,
 static void            check_infinite_types  (sym_table  *tenv_ptr,
                                               absyn_dec  *dec_ptr);
 
+static expty *         expand_call           (tra_level     *level_ptr,
+                                              sym_table     *venv_ptr,
+                                              sym_table     *tenv_ptr,
+                                              env_enventry  *fundec_ptr,
+                                              inl_candidate *candidate_ptr,
+                                              tra_exp_list  *args_ptr,
+                                              temp_label    *break_done);
+
 static tra_exp_list *  check_call_args       (tra_level  *level,
                                               sym_table  *venv,
                                               sym_table  *tenv,
                                               absyn_exp  *exp,
                                               temp_label *break_done);
 
+static tra_exp_list * trans_record_fields    (tra_level  *level_ptr,
+                                              sym_table  *venv_ptr,
+                                              sym_table  *tenv_ptr,
+                                              absyn_exp  *exp_ptr,
+                                              typ_ty     *typ,
+                                              int        *field_count,
+                                              temp_label *break_done);
+
+static tra_exp *      check_local_record     (tra_level  *level_ptr,
+                                              sym_table  *venv_ptr,
+                                              sym_table  *tenv_ptr,
+                                              absyn_dec  *dec_ptr,
+                                              temp_label *break_done);
+
 static tra_exp_list * check_record_init      (tra_level  *level,
                                               sym_table  *venv,
                                               sym_table  *tenv,
@@ -284,7 +317,11 @@ sem_trans_prog (absyn_exp *exp_ptr)
   sym_table *tenv  = env_base_tenv (); /* Get basic type enviroment */
   sym_table *venv  = env_base_venv (); /* Get basic variable enviroment */
   tra_level *outer = tra_outermost_level ();
+  inline_candidates = tab_new_table ();
+  tail_calls        = tab_new_table ();
   esc_find_escaping_var (exp_ptr); /* look for escaping variables */
+  rec_find_local_records (exp_ptr); /* look for records without escape */
+  bnd_find_safe_subscripts (exp_ptr); /* look for subscripts in range */
   /* Do sematic analyse */
   expty *prog = trans_exp (outer, venv, tenv, exp_ptr, NULL);
   tra_proc_entry_exit (outer, prog->exp, NULL);
@@ -368,6 +405,36 @@ check_field_var (tra_level *level_ptr,
                  absyn_var *var_ptr,
                  temp_label *break_done)
 {
+  /* Field of a record that got replaced by scalars */
+  if (var_ptr->u.field.var->kind == ABSYN_SIMPLE_VAR)
+    {
+      env_enventry *enventry = sym_lookup (venv_ptr,
+                                           var_ptr->u.field.var->u.simple);
+      if (enventry != NULL
+          && enventry->kind == ENV_VAR_ENTRY
+          && enventry->u.var.local_record)
+        {
+          typ_field_list  *list   = enventry->u.var.ty->u.record;
+          tra_access_list *fields = enventry->u.var.fields;
+          for (; list != NULL; list = list->tail)
+            {
+              if (list->head->name == var_ptr->u.field.sym)
+                {
+                  /* A wrong initializer left the field without a local */
+                  if (fields == NULL)
+                    return TRANS_ERROR
+                  return new_expty (tra_simple_var (fields->head, level_ptr),
+                                    typ_actual_ty (list->head->ty));
+                }
+              if (fields != NULL)
+                fields = fields->tail;
+            }
+          errm_printf (var_ptr->pos, "Field %s not declared",
+                       sym_name (var_ptr->u.field.sym));
+          return TRANS_ERROR
+        }
+    }
+
   expty *expty = trans_var (level_ptr,
                             venv_ptr,
                             tenv_ptr,
@@ -435,7 +502,9 @@ check_subscript_var (tra_level *level_ptr,
       return new_expty (NULL, typ_new_int ());
     }
 
-  tra_exp *exp = tra_subscript_var (array->exp, index->exp);
+  tra_exp *exp = tra_subscript_var (array->exp,
+                                    index->exp,
+                                    var_ptr->u.subscript.in_range);
   return new_expty (exp, typ_actual_ty (array->ty->u.array));
 }
 
@@ -644,13 +713,83 @@ check_call_exp (tra_level *level_ptr,
   if (tra_list == NULL)
     return TRANS_ERROR;
   */
-  bool lib_fun = (sym_lookup (env_base_venv (), exp_ptr->u.call.func) != NULL);
-  tra_exp *tra_exp = tra_call_exp (lib_fun,
-                                   fundec->u.fun.level,
-                                   level_ptr,
-                                   fundec->u.fun.label,
-                                   tra_list);
-  return new_expty (tra_exp, typ_actual_ty (fundec->u.fun.result));
+  /* Expand small leaf functions in place */
+  inl_candidate *candidate = tab_lookup (inline_candidates, fundec);
+  if (candidate != NULL && !errm_any_errors && inl_scope_matches (candidate))
+    return expand_call (level_ptr,
+                        venv_ptr,
+                        tenv_ptr,
+                        fundec,
+                        candidate,
+                        tra_list,
+                        break_done);
+
+  /* Only the library functions live on the outermost level */
+  bool lib_fun = (fundec->u.fun.level == tra_outermost_level ());
+  tra_exp *tra_exp;
+  if (!lib_fun && tab_lookup (tail_calls, exp_ptr) != NULL)
+    tra_exp = tra_tail_call_exp (fundec->u.fun.level,
+                                 level_ptr,
+                                 fundec->u.fun.label,
+                                 tra_list);
+  else
+    tra_exp = tra_call_exp (lib_fun,
+                            fundec->u.fun.level,
+                            level_ptr,
+                            fundec->u.fun.label,
+                            tra_list);
+
+  /* Library functions returning strings may allocate them */
+  typ_ty *result = typ_actual_ty (fundec->u.fun.result);
+  if (lib_fun && result->kind == TYP_STRING)
+    tra_exp = tra_alloc_site (tra_exp, exp_ptr->pos);
+  return new_expty (tra_exp, result);
+}
+
+/*
+  Translates the body of an inlined function at the call site.
+  Each argument is assigned to a new local of the caller, then the parameters
+  are bound to these locals and the body gets translated in the level of
+  the caller, so static links are followed from there.
+*/
+static expty *
+expand_call (tra_level     *level_ptr,
+             sym_table     *venv_ptr,
+             sym_table     *tenv_ptr,
+             env_enventry  *fundec_ptr,
+             inl_candidate *candidate_ptr,
+             tra_exp_list  *args_ptr,
+             temp_label    *break_done)
+{
+  tra_exp_list     *list    = NULL;
+  absyn_field_list *params  = candidate_ptr->fundec->params;
+  typ_ty_list      *formals = fundec_ptr->u.fun.formals;
+
+  sym_begin_scope (venv_ptr);
+  for (;
+       params != NULL && formals != NULL && args_ptr != NULL;
+       params = params->tail,
+         formals = formals->tail,
+         args_ptr = args_ptr->tail)
+    {
+      tra_access *access = tra_alloc_local (level_ptr, false);
+      tra_exp    *init   = tra_assign_exp (tra_simple_var (access, level_ptr),
+                                           args_ptr->head);
+      list = tra_new_exp_list (init, list);
+
+      env_enventry *enventry = env_new_var_entry (access, formals->head);
+      sym_bind_symbol (venv_ptr, params->head->name, enventry);
+    }
+
+  expty *body = trans_exp (level_ptr,
+                           venv_ptr,
+                           tenv_ptr,
+                           candidate_ptr->fundec->body,
+                           break_done);
+  sym_end_scope (venv_ptr);
+
+  return new_expty (tra_let_exp (list, body->exp),
+                    typ_actual_ty (fundec_ptr->u.fun.result));
 }
 
 /*
@@ -745,47 +884,69 @@ check_record_exp (tra_level  *level_ptr,
   return new_expty (tra_record_exp (tra_list), typ_actual_ty (typ));
   */
 
-  /* Compare fields */
-      absyn_efield_list *el;
-      typ_field_list *fl;
-      tra_exp_list *tel = NULL;
-      expty *exp;
-      int field_count = 0;
+  int           field_count = 0;
+  tra_exp_list *tel         = trans_record_fields (level_ptr,
+                                                   venv_ptr,
+                                                   tenv_ptr,
+                                                   exp_ptr,
+                                                   typ,
+                                                   &field_count,
+                                                   break_done);
+
+  return new_expty (tra_record_exp (tel, field_count, exp_ptr->pos), typ);
+}
 
-      for (el = exp_ptr->u.record.fields, fl = typ->u.record;
-           el
-             && fl; el = el->tail, fl = fl->tail)
+/*
+  Compare fields of a record expression with the record type and
+  translate the initializers. Returns them in reverse order.
+*/
+static tra_exp_list *
+trans_record_fields (tra_level  *level_ptr,
+                     sym_table  *venv_ptr,
+                     sym_table  *tenv_ptr,
+                     absyn_exp  *exp_ptr,
+                     typ_ty     *typ,
+                     int        *field_count,
+                     temp_label *break_done)
+{
+  absyn_efield_list *el;
+  typ_field_list    *fl;
+  tra_exp_list      *tel = NULL;
+
+  for (el = exp_ptr->u.record.fields, fl = typ->u.record;
+       el && fl;
+       el = el->tail, fl = fl->tail)
+    {
+      (*field_count)++;
+      if (strcmp(sym_name (el->head->name), sym_name (fl->head->name)) != 0)
         {
-        field_count++;
-        if (strcmp(sym_name (el->head->name), sym_name (fl->head->name)) != 0)
-          {
-            errm_printf (exp_ptr->pos, "field name should be %s but not %s",
-                         sym_name (fl->head->name),
-                         sym_name (el->head->name));
-            continue;
+          errm_printf (exp_ptr->pos, "field name should be %s but not %s",
+                       sym_name (fl->head->name),
+                       sym_name (el->head->name));
+          continue;
         }
 
-        exp = trans_exp (level_ptr,
-                         venv_ptr,
-                         tenv_ptr,
-                         el->head->exp,
-                         break_done);
+      expty *exp = trans_exp (level_ptr,
+                              venv_ptr,
+                              tenv_ptr,
+                              el->head->exp,
+                              break_done);
 
-        if (!typ_cmpty (fl->head->ty, exp->ty))
-          errm_printf (el->head->exp->pos,
-                       "field type of %s mismatch",
-                       sym_name(fl->head->name));
+      if (!typ_cmpty (fl->head->ty, exp->ty))
+        errm_printf (el->head->exp->pos,
+                     "field type of %s mismatch",
+                     sym_name(fl->head->name));
 
-        tel = tra_new_exp_list (exp->exp, tel);
-        }
-      if (el || fl)
-        {
-          errm_printf (exp_ptr->pos,
-                       "fields of type %s mismatch",
-                       sym_name(exp_ptr->u.record.typ));
-        }
+      tel = tra_new_exp_list (exp->exp, tel);
+    }
+  if (el || fl)
+    {
+      errm_printf (exp_ptr->pos,
+                   "fields of type %s mismatch",
+                   sym_name(exp_ptr->u.record.typ));
+    }
 
-      return new_expty (tra_record_exp (tel, field_count), typ);
+  return tel;
 }
 
 /* See if initializer types are the same like declared types */
@@ -1144,7 +1305,7 @@ check_array_exp (tra_level *level_ptr,
       return TRANS_ERROR
     }
 
-  return new_expty (tra_array_exp (size->exp, init->exp),
+  return new_expty (tra_array_exp (size->exp, init->exp, exp_ptr->pos),
                     typ_actual_ty (ty));
 }
 
@@ -1234,6 +1395,11 @@ check_op_exp (tra_level  *level_ptr,
     case ABSYN_GT_OP:
     case ABSYN_GE_OP:
       {
+        if (left->ty->kind == TYP_STRING && right->ty->kind == TYP_STRING)
+          return new_expty (tra_str_cond_exp (get_tra_op (op),
+                                              left->exp,
+                                              right->exp),
+                            typ_new_int ());
         if (left->ty->kind != TYP_INT)
           {
             errm_printf (exp_ptr->u.op.left->pos, "Integer requierd");
@@ -1258,6 +1424,11 @@ check_op_exp (tra_level  *level_ptr,
                          "Operands must be of the same type");
             return TRANS_ERROR
           }
+        if (left->ty->kind == TYP_STRING)
+          return new_expty (tra_str_cond_exp (get_tra_op (op),
+                                              left->exp,
+                                              right->exp),
+                            typ_new_int ());
         tra_exp *exp = tra_conditional_exp (left->exp,
                                             right->exp,
                                             get_tra_op (op));
@@ -1358,6 +1529,7 @@ process_func_header (tra_level  *level_ptr,
       temp_label     *label     = temp_new_label ();
       util_bool_list *boollist  = mk_formal_escape_list (fundec->params);
       tra_level      *new_level = tra_new_level (level_ptr, label, boollist);
+      ins_name_function (label, fundec->name, fundec->pos);
 
       /* translate arguments, then declare it */
       typ_ty_list  *tylist   = mk_formal_ty_list (tenv_ptr, fundec->params);
@@ -1366,6 +1538,12 @@ process_func_header (tra_level  *level_ptr,
                                                   tylist,
                                                   typ);
       sym_bind_symbol (venv_ptr, fundec->name, enventry);
+
+      inl_candidate *candidate = inl_new_candidate (fundec,
+                                                    venv_ptr,
+                                                    tenv_ptr);
+      if (candidate != NULL)
+        tab_bind_value (inline_candidates, enventry, candidate);
     }
 }
 
@@ -1404,6 +1582,7 @@ process_func_body (sym_table  *venv_ptr,
           sym_bind_symbol (venv_ptr, field->name, enventry);
         }
 
+      find_tail_calls (fundec->body);
       expty *body = trans_exp (func_head->u.fun.level,
                                venv_ptr,
                                tenv_ptr,
@@ -1425,6 +1604,47 @@ process_func_body (sym_table  *venv_ptr,
     }
 }
 
+/*
+  Marks the calls whose result is the result of the function body.
+  Follows the last expression of sequences, both branches of ifs and
+  the body of lets.
+*/
+static void
+find_tail_calls (absyn_exp *exp_ptr)
+{
+  if (exp_ptr == NULL)
+    return;
+
+  switch (exp_ptr->kind)
+    {
+    case ABSYN_CALL_EXP:
+      tab_bind_value (tail_calls, exp_ptr, exp_ptr);
+      return;
+
+    case ABSYN_SEQ_EXP:
+      {
+        absyn_exp_list *list = exp_ptr->u.seq;
+        for (; list != NULL && list->tail != NULL; list = list->tail)
+          ;
+        if (list != NULL)
+          find_tail_calls (list->head);
+        return;
+      }
+
+    case ABSYN_IF_EXP:
+      find_tail_calls (exp_ptr->u.iff.then);
+      find_tail_calls (exp_ptr->u.iff.elsee);
+      return;
+
+    case ABSYN_LET_EXP:
+      find_tail_calls (exp_ptr->u.let.body);
+      return;
+
+    default:
+      return;
+    }
+}
+
 static tra_exp *
 check_type_dec (tra_level *level_ptr,
                 sym_table *venv_ptr,
@@ -1504,6 +1724,13 @@ check_var_dec (tra_level *level_ptr,
                absyn_dec *dec_ptr,
                temp_label *break_done)
 {
+  if (dec_ptr->u.var.local_record)
+    return check_local_record (level_ptr,
+                               venv_ptr,
+                               tenv_ptr,
+                               dec_ptr,
+                               break_done);
+
   expty *init = trans_exp (level_ptr,
                            venv_ptr,
                            tenv_ptr,
@@ -1536,6 +1763,76 @@ check_var_dec (tra_level *level_ptr,
   return tra_assign_exp (tra_simple_var(access, level_ptr), init->exp);
 }
 
+/*
+  Declares a variable whose record does not escape.
+  Every field is held in its own local, so no record gets allocated.
+*/
+static tra_exp *
+check_local_record (tra_level *level_ptr,
+                    sym_table *venv_ptr,
+                    sym_table *tenv_ptr,
+                    absyn_dec *dec_ptr,
+                    temp_label *break_done)
+{
+  absyn_exp *init = dec_ptr->u.var.init;
+  typ_ty    *typ  = typ_lookup (init->pos, init->u.record.typ, tenv_ptr);
+
+  /* Let the normal declaration report the error */
+  if (typ == NULL || typ->kind != TYP_RECORD)
+    {
+      dec_ptr->u.var.local_record = false;
+      return check_var_dec (level_ptr,
+                            venv_ptr,
+                            tenv_ptr,
+                            dec_ptr,
+                            break_done);
+    }
+
+  int           field_count = 0;
+  tra_exp_list *tel         = trans_record_fields (level_ptr,
+                                                   venv_ptr,
+                                                   tenv_ptr,
+                                                   init,
+                                                   typ,
+                                                   &field_count,
+                                                   break_done);
+
+  if (dec_ptr->u.var.typ != NULL)
+    {
+      typ_ty *dec_typ = typ_lookup (dec_ptr->pos, dec_ptr->u.var.typ, tenv_ptr);
+      if (!typ_cmpty (dec_typ, typ))
+        errm_printf (init->pos, "Types do not match");
+    }
+
+  /* Initializers are in reverse order, so are the fields after this */
+  tra_exp_list    *inits  = NULL;
+  tra_access_list *fields = NULL;
+  for (; tel != NULL; tel = tel->tail)
+    {
+      inits  = tra_new_exp_list (tel->head, inits);
+      fields = tra_new_access_list (NULL, fields);
+    }
+
+  /* Assign initializers in order of the fields */
+  tra_exp_list    *list = NULL;
+  tra_access_list *l    = fields;
+  for (; inits != NULL; inits = inits->tail, l = l->tail)
+    {
+      l->head = tra_alloc_local (level_ptr, false);
+      list = tra_new_exp_list (tra_assign_exp (tra_simple_var (l->head,
+                                                               level_ptr),
+                                               inits->head),
+                               list);
+    }
+
+  env_enventry *enventry = env_new_record_entry (fields, typ);
+  sym_bind_symbol (venv_ptr, dec_ptr->u.var.var, enventry);
+
+  if (list == NULL)
+    return tra_type_dec ();
+  return tra_seq_exp (list);
+}
+
 /**
  * Checks kind of type. Calls specific function to handle type.
  * Function will lookup if the type is declared.
@@ -0,0 +1,456 @@
+/**
+ * @file split.c
+ * Live range splitting of temps that got spilled by the coloring.
+ *
+ * The loops of a function are found from the jumps to labels that do not
+ * come later in the instruction list, overlapping loops form one region.
+ * A temp that is used in a region and somewhere else gets a new temp in
+ * every region it is used in. Otherwise every call it lives across gets
+ * its own temp.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "include/util.h"
+#include "include/table.h"
+#include "include/temp.h"
+#include "include/assem.h"
+#include "include/graph.h"
+#include "include/flowgraph.h"
+#include "include/split.h"
+
+typedef struct _split_ctx split_ctx;
+
+/**
+ * The instruction list of a function, numbered, with its loop regions.
+ */
+struct
+_split_ctx
+{
+  assem_instr **insts;
+  long          count;
+  tab_table    *labels;    /* Label to its index + 1 */
+  long         *region;    /* Region of every instruction or -1 */
+  long         *start;     /* First instruction of every region */
+  long         *end;       /* Last instruction of every region */
+  long          regions;
+  tab_table    *group;     /* Temp to the spilled temp it got coalesced to */
+  tab_table    *live_out;  /* Instruction to the temps live after it */
+  tab_table    *before;    /* Instruction to the copies in front of it */
+  tab_table    *after;     /* Instruction to the copies behind it */
+};
+
+/* Local function declarations */
+
+static void find_regions   (split_ctx *ctx);
+
+static bool split_loops    (split_ctx       *ctx,
+                            temp_temp       *t,
+                            temp_temp_list **new_temps);
+
+static bool split_calls    (split_ctx       *ctx,
+                            temp_temp       *t,
+                            temp_temp_list **new_temps);
+
+static bool live_at        (split_ctx *ctx,
+                            long       index,
+                            temp_temp *t);
+
+static void rename_temps   (split_ctx   *ctx,
+                            assem_instr *inst,
+                            temp_temp   *t,
+                            temp_temp   *nt);
+
+static void add_copy       (tab_table   *table,
+                            assem_instr *inst,
+                            temp_temp   *dst,
+                            temp_temp   *src);
+
+/* End local function declarations */
+
+
+/**
+ * Splits the live ranges of spilled temps.
+ *
+ * All temps coalesced to a spilled temp get renamed to it, where its
+ * live range gets split.
+ *
+ * @param il_ptr    The instruction list, gets replaced by the new one.
+ * @param temps     The spilled temps to split.
+ * @param group     Table from every temp to the spilled temp it got
+ *                  coalesced to.
+ * @param live_out  Table from every instruction to the temps live after it.
+ * @param new_temps Gets the new temps prepended.
+ *
+ * @return true if any live range got split.
+ */
+bool
+spl_split_live_ranges (assem_instr_list **il_ptr,
+                       temp_temp_list    *temps,
+                       tab_table         *group,
+                       tab_table         *live_out,
+                       temp_temp_list   **new_temps)
+{
+  split_ctx         ctx;
+  assem_instr_list *il;
+  long              i;
+
+  ctx.count = 0;
+  for (il = *il_ptr; il; il = il->tail)
+    ctx.count++;
+
+  ctx.insts    = new (sizeof (assem_instr*) * (ctx.count + 1));
+  ctx.labels   = tab_new_table ();
+  ctx.group    = group;
+  ctx.live_out = live_out;
+  ctx.before   = tab_new_table ();
+  ctx.after    = tab_new_table ();
+
+  for (i = 0, il = *il_ptr; il; il = il->tail, i++)
+    {
+      ctx.insts[i] = il->head;
+      if (il->head->kind == I_LABEL)
+        tab_bind_value (ctx.labels, il->head->u.label.label, (void*)(i + 1));
+    }
+  find_regions (&ctx);
+
+  bool split = false;
+  for (; temps; temps = temps->tail)
+    {
+      if (split_loops (&ctx, temps->head, new_temps)
+          || split_calls (&ctx, temps->head, new_temps))
+        split = true;
+    }
+
+  if (!split)
+    return false;
+
+  assem_instr_list *rl = NULL;
+  for (i = ctx.count - 1; i >= 0; i--)
+    {
+      rl = assem_splice (tab_lookup (ctx.after, ctx.insts[i]), rl);
+      rl = assem_new_instr_list (ctx.insts[i], rl);
+      rl = assem_splice (tab_lookup (ctx.before, ctx.insts[i]), rl);
+    }
+  *il_ptr = rl;
+  return true;
+}
+
+/**
+ * Returns the index of a label or -1 if it is not in the function.
+ */
+static long
+label_index (split_ctx  *ctx,
+             temp_label *label)
+{
+  return (long)tab_lookup (ctx->labels, label) - 1;
+}
+
+/**
+ * Checks if a list contains a temp coalesced to t.
+ */
+static bool
+in_group (split_ctx      *ctx,
+          temp_temp_list *tl,
+          temp_temp      *t)
+{
+  for (; tl; tl = tl->tail)
+    {
+      if (tab_lookup (ctx->group, tl->head) == t)
+        return true;
+    }
+  return false;
+}
+
+static bool
+references (split_ctx   *ctx,
+            assem_instr *inst,
+            temp_temp   *t)
+{
+  return in_group (ctx, fgraph_inst_use (inst), t)
+    || in_group (ctx, fgraph_inst_def (inst), t);
+}
+
+/**
+ * Marks every instruction between a jump and an earlier label it jumps to.
+ * Runs of marked instructions are the regions.
+ */
+static void
+find_regions (split_ctx *ctx)
+{
+  long  n     = ctx->count;
+  long *delta = new (sizeof (long) * (n + 1));
+  long  i, depth = 0;
+
+  memset (delta, 0, sizeof (long) * (n + 1));
+  for (i = 0; i < n; i++)
+    {
+      if (!fgraph_is_jump (ctx->insts[i]))
+        continue;
+
+      temp_label_list *ll = ctx->insts[i]->u.oper.jumps->labels;
+      for (; ll; ll = ll->tail)
+        {
+          long h = label_index (ctx, ll->head);
+          if (h >= 0 && h <= i)
+            {
+              delta[h]++;
+              delta[i + 1]--;
+            }
+        }
+    }
+
+  ctx->region  = new (sizeof (long) * (n + 1));
+  ctx->start   = new (sizeof (long) * (n + 1));
+  ctx->end     = new (sizeof (long) * (n + 1));
+  ctx->regions = 0;
+
+  for (i = 0; i < n; i++)
+    {
+      depth += delta[i];
+      if (depth == 0)
+        {
+          ctx->region[i] = -1;
+          continue;
+        }
+      if (i == 0 || ctx->region[i - 1] == -1)
+        ctx->start[ctx->regions++] = i;
+      ctx->region[i] = ctx->regions - 1;
+      ctx->end[ctx->regions - 1] = i;
+    }
+}
+
+static long
+region_of (split_ctx *ctx,
+           long       index)
+{
+  return index < 0 ? -1 : ctx->region[index];
+}
+
+/**
+ * Gives t a new temp in every region it is used in. Only done if t is
+ * also used outside of the region, otherwise the copies would just add
+ * to the spilled temp.
+ */
+static bool
+split_loops (split_ctx       *ctx,
+             temp_temp       *t,
+             temp_temp_list **new_temps)
+{
+  temp_temp **nt      = new (sizeof (temp_temp*) * (ctx->regions + 1));
+  long        pieces  = 0;
+  bool        outside = false;
+  long        i, r;
+
+  memset (nt, 0, sizeof (temp_temp*) * (ctx->regions + 1));
+  for (i = 0; i < ctx->count; i++)
+    {
+      if (!references (ctx, ctx->insts[i], t))
+        continue;
+
+      r = ctx->region[i];
+      if (r == -1)
+        outside = true;
+      else if (nt[r] == NULL)
+        {
+          nt[r] = temp_new_temp ();
+          pieces++;
+        }
+    }
+
+  if (pieces + outside < 2)
+    return false;
+
+  for (r = 0; r < ctx->regions; r++)
+    {
+      if (nt[r] != NULL)
+        *new_temps = temp_new_temp_list (nt[r], *new_temps);
+    }
+
+  /* Copies out of a region come first, a jump from one region into
+     another has to store the value before it gets loaded again */
+  for (i = 0; i < ctx->count; i++)
+    {
+      assem_instr *inst = ctx->insts[i];
+      r = ctx->region[i];
+      if (r == -1 || nt[r] == NULL)
+        continue;
+
+      if (fgraph_is_jump (inst))
+        {
+          temp_label_list *ll = inst->u.oper.jumps->labels;
+          for (; ll; ll = ll->tail)
+            {
+              long h = label_index (ctx, ll->head);
+              if (h >= 0 && ctx->region[h] != r && live_at (ctx, h, t))
+                {
+                  add_copy (ctx->before, inst, t, nt[r]);
+                  break;
+                }
+            }
+        }
+
+      if (i == ctx->end[r] && !fgraph_is_uncond_jump (inst)
+          && live_at (ctx, i + 1, t))
+        add_copy (ctx->after, inst, t, nt[r]);
+    }
+
+  for (i = 0; i < ctx->count; i++)
+    {
+      assem_instr *inst = ctx->insts[i];
+
+      if (fgraph_is_jump (inst))
+        {
+          temp_label_list *ll   = inst->u.oper.jumps->labels;
+          long             last = -1;
+          for (; ll; ll = ll->tail)
+            {
+              long h = label_index (ctx, ll->head);
+              r = region_of (ctx, h);
+              if (r == -1 || r == last || nt[r] == NULL
+                  || r == ctx->region[i] || !live_at (ctx, h, t))
+                continue;
+
+              add_copy (ctx->before, inst, nt[r], t);
+              last = r;
+            }
+        }
+
+      /* Falling into a region */
+      r = ctx->region[i];
+      if (r == -1 || nt[r] == NULL || i != ctx->start[r] || i == 0)
+        continue;
+
+      long p = i - 1;
+      while (p > 0 && ctx->insts[p]->kind == I_LABEL)
+        p--;
+      if (!fgraph_is_uncond_jump (ctx->insts[p]) && live_at (ctx, i, t))
+        add_copy (ctx->before, inst, nt[r], t);
+    }
+
+  for (i = 0; i < ctx->count; i++)
+    {
+      r = ctx->region[i];
+      rename_temps (ctx, ctx->insts[i], t, r == -1 || nt[r] == NULL ? t : nt[r]);
+    }
+  return true;
+}
+
+/**
+ * Gives t a new temp around every call it lives across. Calls only
+ * define registers, so t is live before the call as well.
+ */
+static bool
+split_calls (split_ctx       *ctx,
+             temp_temp       *t,
+             temp_temp_list **new_temps)
+{
+  bool split = false;
+  long i;
+
+  for (i = 0; i < ctx->count; i++)
+    {
+      assem_instr *inst = ctx->insts[i];
+      if (inst->kind != I_OPER || strncmp (inst->u.oper.assem, "call ", 5) != 0
+          || !in_group (ctx, tab_lookup (ctx->live_out, inst), t))
+        continue;
+
+      temp_temp *nt = temp_new_temp ();
+      *new_temps = temp_new_temp_list (nt, *new_temps);
+
+      add_copy (ctx->before, inst, nt, t);
+      add_copy (ctx->after, inst, t, nt);
+      split = true;
+    }
+
+  if (split)
+    {
+      for (i = 0; i < ctx->count; i++)
+        rename_temps (ctx, ctx->insts[i], t, t);
+    }
+  return split;
+}
+
+/**
+ * Checks if t is live in front of the instruction at index.
+ */
+static bool
+live_at (split_ctx *ctx,
+         long       index,
+         temp_temp *t)
+{
+  for (; index < ctx->count; index++)
+    {
+      assem_instr *inst = ctx->insts[index];
+      if (inst->kind == I_LABEL)
+        continue;
+
+      if (in_group (ctx, fgraph_inst_use (inst), t))
+        return true;
+      if (in_group (ctx, fgraph_inst_def (inst), t))
+        return false;
+      return in_group (ctx, tab_lookup (ctx->live_out, inst), t);
+    }
+  return false;
+}
+
+static temp_temp_list *
+rename_list (split_ctx      *ctx,
+             temp_temp_list *tl,
+             temp_temp      *t,
+             temp_temp      *nt)
+{
+  temp_temp_list *rl = NULL;
+  for (; tl; tl = tl->tail)
+    {
+      temp_temp *x = tl->head;
+      if (tab_lookup (ctx->group, x) == t)
+        x = nt;
+      rl = temp_new_temp_list (x, rl);
+    }
+  return temp_reverse_list (rl);
+}
+
+/**
+ * Replaces every temp coalesced to t by nt. The lists are shared with the
+ * liveness sets, so new ones are built.
+ */
+static void
+rename_temps (split_ctx   *ctx,
+              assem_instr *inst,
+              temp_temp   *t,
+              temp_temp   *nt)
+{
+  if (!references (ctx, inst, t))
+    return;
+
+  if (inst->kind == I_OPER)
+    {
+      inst->u.oper.src = rename_list (ctx, inst->u.oper.src, t, nt);
+      inst->u.oper.dst = rename_list (ctx, inst->u.oper.dst, t, nt);
+    }
+  else if (inst->kind == I_MOVE)
+    {
+      inst->u.move.src = rename_list (ctx, inst->u.move.src, t, nt);
+      inst->u.move.dst = rename_list (ctx, inst->u.move.dst, t, nt);
+    }
+}
+
+/**
+ * Appends the copy of src to dst to the copies of an instruction.
+ */
+static void
+add_copy (tab_table   *table,
+          assem_instr *inst,
+          temp_temp   *dst,
+          temp_temp   *src)
+{
+  assem_instr *copy = assem_new_move ("movl `s0, `d0\n",
+                                      temp_new_temp_list (dst, NULL),
+                                      temp_new_temp_list (src, NULL));
+  tab_bind_value (table, inst,
+                  assem_splice (tab_lookup (table, inst),
+                                assem_new_instr_list (copy, NULL)));
+}
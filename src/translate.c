@@ -6,6 +6,7 @@
 #include <assert.h>
 
 //#include "include/list.h"
+#include "include/errormsg.h"
 #include "include/frame.h"
 #include "include/translate.h"
 #include "include/tree.h"
@@ -16,6 +17,23 @@ typedef struct _patch_list patch_list;
 /* Private global list to save all function and string fragments */
 static frm_frag_list *frag_list = NULL;
 
+/*
+  The display holds for every nesting depth the static link of the latest
+  activation of a function at that depth. Only functions whose variables
+  are accessed over more than one static link register themselves in it.
+*/
+static temp_label *display_label = NULL;
+static int         display_size  = 0;
+
+/* Check array subscripts against the length in front of the array */
+static bool bounds_check = false;
+
+/*
+  Store the site of every allocation in heapSite of the runtime before
+  the allocating call. The site is line << 10 | column of the expression.
+*/
+static bool heap_profile = false;
+
 struct
 _patch_list
 {
@@ -38,6 +56,10 @@ _tra_level
 {
   tra_level       *parent;
   frm_frame       *frame;
+  temp_label      *entry;  /* Target of self tail calls, NULL if unused */
+  int              depth;  /* Nesting depth, 0 for the outermost level */
+  bool             display;    /* Frame gets registered in the display */
+  tree_exp_list   *tail_calls; /* Calls that reuse the frame */
   //tra_access_list *formals;
   //tra_access_list *locals;
 };
@@ -96,6 +118,19 @@ static void         do_patch              (patch_list *tlist_ptr,
 
 static void         frag_list_add         (frm_frag *frag_ptr);
 
+static tree_exp *   static_link_exp       (tra_level *funclv,
+                                           tra_level *lv);
+
+static tree_exp *   frame_link_exp        (tra_level *from,
+                                           tra_level *to);
+
+static tree_exp *   display_exp           (tra_level *level);
+
+static tree_exp *   site_call             (tree_exp *call,
+                                           int       pos);
+
+static int          formals_count         (tra_level *level);
+
 static condit_exp * new_condit            (tree_stm   *stm_ptr,
                                            patch_list *trues_ptr,
                                            patch_list *falses_ptr);
@@ -154,6 +189,10 @@ tra_new_level (tra_level      *parent_ptr,
 
   new_level->frame   = frm_new_frame (name_ptr, formals_ptr);
   new_level->parent  = parent_ptr;
+  new_level->entry   = NULL;
+  new_level->depth   = parent_ptr ? parent_ptr->depth + 1 : 0;
+  new_level->display = false;
+  new_level->tail_calls = NULL;
   //new_level->formals = new_formals (new_level);
   //new_level->locals  = NULL;
 
@@ -245,6 +284,30 @@ tra_proc_entry_exit (tra_level       *level,
                      tra_access_list *formals)
 {
   tree_stm *stm = tree_new_move (tree_new_temp (frm_rv ()), conv_exp (body));
+  if (level->entry != NULL)
+    stm = tree_new_seq (tree_new_label (level->entry), stm);
+
+  if (level->display)
+    {
+      /*
+        Save the entry of the display in the frame, a temp would occupy
+        a register over the whole body. Then register the frame.
+      */
+      frm_access *saved = frm_alloc_local (level->frame, true);
+      tree_exp   *fp    = tree_new_temp (frm_fp ());
+      tree_stm   *save  = tree_new_seq (tree_new_move (frm_exp (saved, fp),
+                                                       display_exp (level)),
+                                        tree_new_move (display_exp (level),
+                                                       frm_static_link_exp (fp)));
+      tree_stm   *restore = tree_new_move (display_exp (level),
+                                           frm_exp (saved, fp));
+      stm = tree_new_seq (save, tree_new_seq (stm, restore));
+
+      /* The display has to be restored, so the frame cannot be reused */
+      tree_exp_list *tail_calls = level->tail_calls;
+      for (; tail_calls; tail_calls = tail_calls->tail)
+        tail_calls->head->u.call.tail = false;
+    }
   frm_frag *frag = frm_new_proc_frag (stm, level->frame);
   frag_list_add (frag);
   frm_proc_entry_exit1 (level->frame, stm);
@@ -282,21 +345,9 @@ tra_simple_var (tra_access *access,
       return trans_exp (frm_exp (access->access,
                                  tree_new_temp (frm_fp ())));
     }
-  else /* Calculate offset with static links. */
+  else /* Calculate offset with static links or the display. */
     {
-      tree_exp *static_link = frm_static_link_exp (tree_new_temp (frm_fp ()));
-      /*
-        tree_exp *mem = get_offset (level,
-                                  access->level,
-                                  frm_fp ());
-
-      return trans_exp (frm_exp (access->access, mem));
-      */
-      while (access->level != level)
-        {
-          static_link = frm_upper_static_link_exp (static_link);
-          level = level->parent;
-        }
+      tree_exp *static_link = frame_link_exp (level, access->level);
       return trans_exp (frm_exp_with_static_link (access->access, static_link));
     }
 }
@@ -325,34 +376,111 @@ tra_field_var (tra_exp *record_ptr,
   return trans_exp (mem);
 }
 
+/**
+ * Selects if array subscripts get checked against the array length.
+ */
+void
+tra_set_bounds_check (bool check)
+{
+  bounds_check = check;
+}
+
+/**
+ * Selects if allocations record their site for the heap profile
+ * of the runtime.
+ */
+void
+tra_set_heap_profile (bool profile)
+{
+  heap_profile = profile;
+}
+
+/**
+ * Makes a call to a function that allocates memory record its site,
+ * if the heap gets profiled.
+ *
+ * @param call_ptr Call to a library function.
+ * @param pos      Position of the call.
+ *
+ * @return Intermediate code representation.
+ */
+tra_exp *
+tra_alloc_site (tra_exp *call_ptr,
+                int      pos)
+{
+  if (!heap_profile)
+    return call_ptr;
+  return trans_exp (site_call (conv_exp (call_ptr), pos));
+}
+
 /**
  * Calculates the offset of a array variable and turns it
- * into the intermediate code representation.
+ * into the intermediate code representation. With bounds checks
+ * the index gets compared unsigned against the length, which is
+ * stored one word in front of the first element, so negative
+ * indices fail too.
  *
  * @param array_ptr The memory location of the first array element.
  * @param index_ptr The index of the element.
+ * @param in_range  True if the index is known to be in range.
  *
  * @return Intermediate code representation.
  */
 tra_exp *
 tra_subscript_var (tra_exp* array_ptr,
-                   tra_exp* index_ptr)
+                   tra_exp* index_ptr,
+                   bool     in_range)
 {
-  tree_exp *index          = conv_exp (index_ptr);
-  tree_exp *word_size      = tree_new_const (frm_word_size);
-  tree_exp *element_offset = tree_new_bin_op (TREE_TIMES, index, word_size);
-  tree_exp *element        = tree_new_bin_op (TREE_PLUS,
-                                              conv_exp (array_ptr),
-                                              element_offset);
-  tree_exp *mem            = tree_new_mem (element);
+  tree_exp *array     = conv_exp (array_ptr);
+  tree_exp *index     = conv_exp (index_ptr);
+  tree_exp *word_size = tree_new_const (frm_word_size);
 
-  return trans_exp (mem);
- /*
-   return trans_exp (tree_new_mem(
-          tree_new_bin_op(TREE_PLUS, conv_exp (array_ptr),
-            tree_new_bin_op(TREE_TIMES, conv_exp (index_ptr),
-                            tree_new_const(frm_word_size)))));
-   */
+  if (!bounds_check || in_range)
+    {
+      tree_exp *element_offset = tree_new_bin_op (TREE_TIMES, index, word_size);
+      tree_exp *element        = tree_new_bin_op (TREE_PLUS,
+                                                  array,
+                                                  element_offset);
+      return trans_exp (tree_new_mem (element));
+    }
+
+  temp_temp  *a   = temp_new_temp ();
+  temp_temp  *i   = temp_new_temp ();
+  temp_label *ok  = temp_new_label ();
+  temp_label *bad = temp_new_label ();
+
+  tree_exp *length = tree_new_mem (
+    tree_new_bin_op (TREE_PLUS,
+                     tree_new_temp (a),
+                     tree_new_const (-frm_word_size)));
+  tree_exp_list *args = tree_new_exp_list (
+    tree_new_temp (i),
+    tree_new_exp_list (
+      tree_new_mem (tree_new_bin_op (TREE_PLUS,
+                                     tree_new_temp (a),
+                                     tree_new_const (-frm_word_size))),
+      NULL));
+
+  tree_stm *check =
+    tree_new_seq (
+      tree_new_move (tree_new_temp (a), array),
+      tree_new_seq (
+        tree_new_move (tree_new_temp (i), index),
+        tree_new_seq (
+          tree_new_cjump (TREE_ULT, tree_new_temp (i), length, ok, bad),
+          tree_new_seq (
+            tree_new_label (bad),
+            tree_new_seq (
+              tree_new_exp (frm_external_call ("subscriptError", args)),
+              tree_new_label (ok))))));
+
+  tree_exp *element = tree_new_bin_op (
+    TREE_PLUS,
+    tree_new_temp (a),
+    tree_new_bin_op (TREE_TIMES, tree_new_temp (i), word_size));
+
+  /* ESEQ below MEM, so the element works as source and destination */
+  return trans_exp (tree_new_mem (tree_new_eseq (check, element)));
 }
 
 /**
@@ -488,7 +616,8 @@ tra_conditional_exp (tra_exp *left_ptr,
 }
 
 /**
- * Special conditional if comparing two strings.
+ * Special conditional if comparing two strings. = and <> call stringEqual,
+ * the other operators compare the result of stringCompare with zero.
  *
  * @param o Operator.
  * @param left Left expression.
@@ -534,11 +663,15 @@ tra_str_cond_exp(TRA_OP   o,
                                                     tree_new_exp_list (conv_exp (right),
                                                                    NULL)));
     s = tree_new_cjump (op, e, tree_new_const (1), NULL, NULL);
-    /* String compare */
     }
+  /* String compare, the sign of the result orders the strings */
   else
     {
-      assert(0);  // Not implemented
+      tree_exp *e = frm_external_call ("stringCompare",
+                                       tree_new_exp_list (conv_exp (left),
+                                                          tree_new_exp_list (conv_exp (right),
+                                                                             NULL)));
+      s = tree_new_cjump (op, e, tree_new_const (0), NULL, NULL);
     }
   patch_list *trues = new_patch_list (&s->u.cjump.truee, NULL);
   patch_list *falses = new_patch_list (&s->u.cjump.falsee, NULL);
@@ -616,18 +749,20 @@ tra_if_exp (tra_exp* test_ptr,
  *
  * @param size_ptr The size of the array.
  * @param init_ptr Initial value of every element.
+ * @param pos      Position of the array expression.
  *
  * @return Intermediate code representation.
  */
 tra_exp *
 tra_array_exp (tra_exp *size,
-               tra_exp *init)
+               tra_exp *init,
+               int      pos)
 {
   tree_exp_list *args = tree_new_exp_list (conv_exp (size),
                                            tree_new_exp_list (conv_exp (init),
                                                               NULL));
   /* Call external function that handels the init */
-  return trans_exp (frm_external_call ("initArray", args));
+  return trans_exp (site_call (frm_external_call ("initArray", args), pos));
 }
 
 /**
@@ -635,12 +770,14 @@ tra_array_exp (tra_exp *size,
  *
  * @param list_ptr The initialisation expressions.
  * @param num      The number of initial expressions.
+ * @param pos      Position of the record expression.
  *
  * @return Intermediate code representation.
  */
 tra_exp *
 tra_record_exp (tra_exp_list *tra_list,
-                int           field_count)
+                int           field_count,
+                int           pos)
 {
   /*
     Call external function malloc, save pointer in register record.
@@ -688,12 +825,13 @@ tra_record_exp (tra_exp_list *tra_list,
                                      seq_start);
   return trans_exp (tree_new_eseq (init_seq, record));
   */
+  /* Every field gets initialized below, so the memory needs no zeroing */
   temp_temp *r = temp_new_temp ();
   tree_stm * alloc = tree_new_move (tree_new_temp (r),
-                  frm_external_call ("allocRecord",
+                  site_call (frm_external_call ("allocRecordUninit",
                                      tree_new_exp_list (tree_new_const (field_count
                                                                         * frm_word_size)
-                                                        , NULL)));
+                                                        , NULL)), pos));
 
   /* Init fields */
   tree_stm *init = NULL, *current = NULL;
@@ -895,27 +1033,199 @@ tra_call_exp (bool          is_lib_func,
 
   /* Static link */
   if (!is_lib_func)
-    {
-      tra_level *current     = lv;
-      tree_exp  *static_link = frm_static_link_exp (tree_new_temp (frm_fp ()));
-    /* Finding static link iteratively */
-    if (funclv->parent != current)
-      {
-        while (current)
-          {
-            static_link = tree_new_mem (static_link);
-            if (funclv->parent == current->parent)
-              {
-                break;
-              }
-            current = current->parent;
-          }
-      }
-    el = tree_new_exp_list (static_link, el);
-  }
+    el = tree_new_exp_list (static_link_exp (funclv, lv), el);
+
   return trans_exp (tree_new_call (tree_new_name (name), el));
 }
 
+/**
+ * Translates a call in tail position into intermediate code represenation.
+ *
+ * A call of the function itself becomes a jump back to the entry of the
+ * body after the arguments are assigned to the formals. Other calls reuse
+ * the frame of the caller, if the arguments fit into the incoming argument
+ * area of the caller and the callee does not expect a static link into
+ * the frame that gets released. Everything else is a normal call.
+ *
+ * @param funclv Level where function is declared.
+ * @param lv     Level where function is called.
+ * @param name   The function name.
+ * @param rawel  Function arguments.
+ *
+ * @return Intermediate code.
+ */
+tra_exp *
+tra_tail_call_exp (tra_level    *funclv,
+                   tra_level    *lv,
+                   temp_label   *name,
+                   tra_exp_list *rawel)
+{
+  if (funclv == lv)
+    {
+      /* Evaluate all arguments before the first formal gets overwritten */
+      tree_stm        *moves   = NULL;
+      tree_stm        *assigns = NULL;
+      frm_access_list *formals = frm_formals (lv->frame);
+      for (; rawel && formals; rawel = rawel->tail, formals = formals->tail)
+        {
+          temp_temp *t = temp_new_temp ();
+          tree_stm  *move   = tree_new_move (tree_new_temp (t),
+                                             conv_exp (rawel->head));
+          tree_stm  *assign = tree_new_move (frm_exp (formals->head,
+                                                      tree_new_temp (frm_fp ())),
+                                             tree_new_temp (t));
+          moves   = moves   ? tree_new_seq (moves, move)     : move;
+          assigns = assigns ? tree_new_seq (assigns, assign) : assign;
+        }
+
+      if (lv->entry == NULL)
+        lv->entry = temp_new_label ();
+
+      tree_stm *jump = tree_new_jump (tree_new_name (lv->entry),
+                                      temp_new_label_list (lv->entry, NULL));
+      if (assigns != NULL)
+        jump = tree_new_seq (moves, tree_new_seq (assigns, jump));
+
+      return trans_exp (tree_new_eseq (jump, tree_new_const (0)));
+    }
+
+  /* Static link of a nested function would point into the released frame */
+  if (funclv->parent == lv || formals_count (funclv) > formals_count (lv))
+    return tra_call_exp (false, funclv, lv, name, rawel);
+
+  tree_exp_list *el = NULL, *last_el = NULL;
+  for (; rawel; rawel = rawel->tail)
+    {
+      tree_exp_list *l = tree_new_exp_list (conv_exp (rawel->head), NULL);
+      if (last_el == NULL)
+        el = last_el = l;
+      else
+        last_el = last_el->tail = l;
+    }
+  el = tree_new_exp_list (static_link_exp (funclv, lv), el);
+
+  tree_exp *call = tree_new_tail_call (tree_new_name (name), el);
+  lv->tail_calls = tree_new_exp_list (call, lv->tail_calls);
+  return trans_exp (call);
+}
+
+/**
+ * Calculates the static link for a call of a function declared in funclv
+ * from the level lv. Static links are followed iteratively.
+ */
+static tree_exp *
+static_link_exp (tra_level *funclv,
+                 tra_level *lv)
+{
+  return frame_link_exp (lv, funclv->parent);
+}
+
+/**
+ * Calculates the static link of the activation of the enclosing level to
+ * as seen from the level from. One static link is followed directly,
+ * further up the display is used, so this takes at most one memory access.
+ */
+static tree_exp *
+frame_link_exp (tra_level *from,
+                tra_level *to)
+{
+  tree_exp *static_link = frm_static_link_exp (tree_new_temp (frm_fp ()));
+
+  if (from == to)
+    return static_link;
+
+  if (from->parent == to)
+    return frm_upper_static_link_exp (static_link);
+
+  return display_exp (to);
+}
+
+/**
+ * Returns the display entry of a level and marks the level as user of
+ * the display.
+ */
+static tree_exp *
+display_exp (tra_level *level)
+{
+  if (display_label == NULL)
+    display_label = temp_named_label ("tigerdisplay");
+
+  level->display = true;
+  if (level->depth >= display_size)
+    display_size = level->depth + 1;
+
+  return tree_new_mem (tree_new_bin_op (TREE_PLUS,
+                                        tree_new_name (display_label),
+                                        tree_new_const (level->depth
+                                                        * frm_word_size)));
+}
+
+/**
+ * Returns the label of the display.
+ *
+ * @return Label or NULL if no function uses the display.
+ */
+temp_label *
+tra_display_label (void)
+{
+  return display_label;
+}
+
+/**
+ * Returns the number of entries in the display.
+ *
+ * @return Number of entries.
+ */
+int
+tra_display_size (void)
+{
+  return display_size;
+}
+
+/*
+  Stores the site of an allocation in heapSite. The arguments get evaluated
+  into temporaries first, so allocations in them do not overwrite the site.
+*/
+static tree_exp *
+site_call (tree_exp *call,
+           int       pos)
+{
+  int line, col;
+  if (!heap_profile || call->kind != TREE_CALL)
+    return call;
+  if (!errm_line_col (pos, &line, &col))
+    line = col = 0;
+  if (col > 1023)
+    col = 1023;
+
+  tree_stm *stm = NULL;
+  tree_exp_list *args = call->u.call.args;
+  for (; args != NULL; args = args->tail)
+    {
+      temp_temp *t    = temp_new_temp ();
+      tree_stm  *move = tree_new_move (tree_new_temp (t), args->head);
+      stm        = stm ? tree_new_seq (stm, move) : move;
+      args->head = tree_new_temp (t);
+    }
+
+  tree_stm *site = tree_new_move (
+    tree_new_mem (tree_new_name (temp_named_label ("heapSite"))),
+    tree_new_const (line << 10 | col));
+  stm = stm ? tree_new_seq (stm, site) : site;
+
+  return tree_new_eseq (stm, call);
+}
+
+static int
+formals_count (tra_level *level)
+{
+  int              count   = 0;
+  frm_access_list *formals = frm_formals (level->frame);
+  for (; formals; formals = formals->tail)
+    count++;
+  return count;
+}
+
 /**
  * Translates a nil expression into intermediate code.
  *
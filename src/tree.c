@@ -173,6 +173,22 @@ tree_new_call (tree_exp      *fun_ptr,
   p->kind        = TREE_CALL;
   p->u.call.fun  = fun_ptr;
   p->u.call.args = args_ptr;
+  p->u.call.tail = false;
+
+  return p;
+}
+
+/**
+ * Creates a call in tail position. The callee takes over the frame of the
+ * caller and returns directly to the caller's caller.
+ */
+tree_exp *
+tree_new_tail_call (tree_exp      *fun_ptr,
+                    tree_exp_list *args_ptr)
+{
+  tree_exp *p = tree_new_call (fun_ptr, args_ptr);
+
+  p->u.call.tail = true;
 
   return p;
 }
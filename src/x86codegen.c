@@ -24,6 +24,8 @@ static assem_instr_list *global_instr_list_last = NULL;
 
 static bool last_is_label = false;  // reserved for "nop"
 
+static frm_frame *frame = NULL;     // Frame of the function being munched
+
 static temp_temp *      munch_exp            (tree_exp *e);
 
 static void             munch_stm            (tree_stm *s);
@@ -31,9 +33,9 @@ static void             munch_stm            (tree_stm *s);
 static temp_temp_list * munch_args           (int            i,
                                               tree_exp_list *args);
 
-static void             munch_caller_save    (void);
+static void             munch_pop_args       (temp_temp_list *tl);
 
-static void             munch_caller_restore (temp_temp_list *tl);
+static void             munch_tail_call      (tree_exp *call);
 
 
 static void
@@ -60,6 +62,7 @@ codegen (frm_frame     *f,
   tree_stm_list    *sl;
 
   /* miscellaneous initializations as necessary */
+  frame = f;
 
   for (sl = stm_list; sl; sl = sl->tail)
     {
@@ -378,8 +381,13 @@ generate_call (tree_exp *e,
                char     *inst,
                char     *inst2)
 {
+  if (e->u.call.tail)
+    {
+      munch_tail_call (e);
+      return frm_rv ();
+    }
+
   /* CALL(NAME(lab),args) */
-  munch_caller_save();
   temp_label *lab = e->u.call.fun->u.name;
   tree_exp_list *args = e->u.call.args;
   temp_temp *t = temp_new_temp();
@@ -388,9 +396,9 @@ generate_call (tree_exp *e,
   sprintf(inst, "call %s\n", temp_label_str(lab));
   emit(assem_new_oper(inst,
                       temp_new_temp_list (frm_rv(), calldefs),
-                      l,
+                      temp_new_temp_list (frm_sp(), NULL),
                       NULL));
-  munch_caller_restore(l);
+  munch_pop_args (l);
   sprintf(inst2, "movl `s0, `d0\n");
   emit(assem_new_move(inst2,
                       temp_new_temp_list (t, NULL),
@@ -543,10 +551,13 @@ generate_move (tree_stm *s,
      {
        if (src->kind == TREE_CALL)
          {
-           if (src->u.call.fun->kind == TREE_NAME)
+           if (src->u.call.tail)
+             {
+               munch_tail_call (src);
+             }
+           else if (src->u.call.fun->kind == TREE_NAME)
              {
                /* MOVE(TEMP(t),CALL(NAME(lab),args)) */
-               munch_caller_save();
                temp_label *lab = src->u.call.fun->u.name;
                tree_exp_list *args = src->u.call.args;
                temp_temp * t = dst->u.temp;
@@ -555,9 +566,9 @@ generate_move (tree_stm *s,
                sprintf(inst, "call %s\n", temp_label_str(lab));
                emit(assem_new_oper (inst,
                                     temp_new_temp_list (frm_rv(), calldefs),
-                                    l,
+                                    temp_new_temp_list (frm_sp(), NULL),
                                     NULL));
-               munch_caller_restore (l);
+               munch_pop_args (l);
                sprintf(inst2, "movl `s0, `d0\n");
                emit(assem_new_move(inst2,
                                    temp_new_temp_list (t, NULL),
@@ -613,17 +624,23 @@ generate_exp (tree_stm *s,
   if (s->u.exp->kind == TREE_CALL)
     {
       tree_exp *call = s->u.exp;
-      if (call->u.call.fun->kind == TREE_NAME)
+      if (call->u.call.tail)
+        {
+          munch_tail_call (call);
+        }
+      else if (call->u.call.fun->kind == TREE_NAME)
         {
           /* EXP(CALL(NAME(lab),args)) */
-          munch_caller_save();
           temp_label *lab = call->u.call.fun->u.name;
           tree_exp_list *args = call->u.call.args;
           temp_temp_list *l = munch_args(0, args);
           temp_temp_list *calldefs = frm_caller_saves();
           sprintf(inst, "call %s\n", temp_label_str (lab));
-          emit(assem_new_oper(inst, calldefs, l, NULL));
-          munch_caller_restore(l);
+          emit(assem_new_oper(inst,
+                              temp_new_temp_list (frm_rv(), calldefs),
+                              temp_new_temp_list (frm_sp(), NULL),
+                              NULL));
+          munch_pop_args (l);
         }
       else
         {
@@ -649,7 +666,7 @@ generate_jump (tree_stm *s,
       temp_label *lab = s->u.jmp.exp->u.name;
       temp_label_list *jumps = s->u.jmp.jumps;
       sprintf(inst, "jmp `j0\n");
-      emit(assem_new_oper(inst, NULL, NULL, assem_new_targets(jumps)));
+      emit(assem_new_oper(inst, NULL, NULL, assem_new_uncond_targets(jumps)));
     }
   else
     {
@@ -660,7 +677,7 @@ generate_jump (tree_stm *s,
       emit(assem_new_oper(inst,
                           NULL,
                           temp_new_temp_list (munch_exp(e), NULL),
-                          assem_new_targets (jumps)));
+                          assem_new_uncond_targets (jumps)));
     }
 }
 
@@ -715,7 +732,7 @@ generate_cjump (tree_stm *s,
   emit(assem_new_oper(inst3,
                       NULL,
                       NULL,
-                      assem_new_targets(temp_new_label_list (jf, NULL))));
+                      assem_new_uncond_targets(temp_new_label_list (jf, NULL))));
 }
 
 static void
@@ -747,20 +764,13 @@ munch_stm (tree_stm *s)
     }
 }
 
+/*
+  Removes the arguments from the stack after a call. The caller saves are
+  not saved around the call, they are defined by the call instruction, so
+  the register allocator keeps values that live across the call elsewhere.
+*/
 static void
-munch_caller_save ()
-{
-  temp_temp_list *caller_saves = frm_caller_saves();
-
-  for (; caller_saves; caller_saves = caller_saves->tail)
-    emit(assem_new_oper("pushl `s0\n",
-                        temp_new_temp_list (frm_sp(), NULL),
-                        temp_new_temp_list (caller_saves->head, NULL),
-                        NULL));
-}
-
-static void
-munch_caller_restore(temp_temp_list *tl)
+munch_pop_args (temp_temp_list *tl)
 {
   int restore_cnt = 0;
   char *inst = new (sizeof (char) * 128);
@@ -773,13 +783,43 @@ munch_caller_restore(temp_temp_list *tl)
                       temp_new_temp_list (frm_sp(), NULL),
                       temp_new_temp_list (frm_sp(), NULL),
                       NULL));
+}
+
+/*
+  TAILCALL(NAME(lab),args)
+  Overwrites the incoming arguments of the current frame with the new ones.
+  All arguments are evaluated before the first one gets stored, because
+  they may read the old values. The frame is released before the jump.
+*/
+static void
+munch_tail_call (tree_exp *call)
+{
+  temp_temp_list *l = NULL, *last = NULL;
+  tree_exp_list  *args = call->u.call.args;
+  for (; args; args = args->tail)
+    {
+      temp_temp_list *t = temp_new_temp_list (munch_exp (args->head), NULL);
+      if (last == NULL)
+        l = last = t;
+      else
+        last = last->tail = t;
+    }
+
+  /* Static link is at 8(%ebp), first argument at 12(%ebp) */
+  int offset = 2 * frm_word_size;
+  for (; l; l = l->tail, offset += frm_word_size)
+    {
+      char *inst = new (sizeof (char) * 120);
+      sprintf(inst, "movl `s0, %d(`s1)\n", offset);
+      emit(assem_new_oper(inst,
+                          NULL,
+                          temp_new_temp_list (l->head,
+                                              temp_new_temp_list (frm_fp (),
+                                                                  NULL)),
+                          NULL));
+    }
 
-  temp_temp_list *caller_saves = temp_reverse_list(frm_caller_saves());
-  for (; caller_saves; caller_saves = caller_saves->tail)
-    emit(assem_new_oper("popl `d0\n",
-                        temp_new_temp_list (caller_saves->head, NULL),
-                        temp_new_temp_list (frm_sp(), NULL),
-                        NULL));
+  emit(frm_tail_jump (frame, call->u.call.fun->u.name));
 }
 
 static temp_temp_list *
@@ -796,6 +836,6 @@ munch_args (int            i,
                        temp_new_temp_list (frm_sp(), NULL),
                        temp_new_temp_list (r, NULL), NULL));
 
-  // No need to reserve values before calling in x86
+  // The arguments are on the stack, the call does not use the temps
   return temp_new_temp_list (r, old);
 }
@@ -65,6 +65,9 @@ _frm_frame
   temp_map        *temp;
   frm_access_list *formals;
   frm_access_list *locals;
+  assem_instr_list *tail_jumps; /* Jumps of calls that reuse this frame */
+  temp_temp_list  *saved;       /* Callee saves used by the body */
+  bool             has_frame;   /* false if %ebp is not set up */
   //int              locals_cnt;
 };
 
@@ -77,6 +80,10 @@ static int               calc_offset           (int num_of_arg);
 static void              bind_temp             (temp_temp *label,
                                                 char      *name);
 
+static void              scan_body             (frm_frame        *frame,
+                                                assem_instr_list *body,
+                                                temp_map         *coloring);
+
 frm_frame_list *
 frm_new_frame_list (frm_frame *head,
                     frm_frame_list *tail)
@@ -150,23 +157,32 @@ frm_new_frame (temp_label     *name_ptr,
     %ebp:     old %ebp
     %ebp + 4: static link
     arguments start from %ebp + 12:
-    local variables start from %ebp - 4 - 12 (calle saves)
+    local variables start from %ebp - 4,
+    the used callee saves get pushed below the local variables
    */
   frm_frame *frame   = new (sizeof (*frame));
   frame->start_label = name_ptr;
   //frame->formals     = formals_esc_to_access (formals_ptr);
   int              offset     = 8;
   util_bool_list  *formal_esc = formals_ptr;
-  frm_access_list *formal     = NULL;
+  frm_access_list *formal     = NULL, *last_formal = NULL;
   while (formal_esc)
     {
       offset += 4;
-      formal = frm_new_access_list (in_frame (offset), formal);
+      /* Insert at tail, first argument is nearest to the static link */
+      if (last_formal == NULL)
+        formal = last_formal = frm_new_access_list (in_frame (offset), NULL);
+      else
+        last_formal = last_formal->tail = frm_new_access_list (in_frame (offset),
+                                                               NULL);
       formal_esc = formal_esc->tail;
     }
   frame->formals = formal;
   frame->locals  = NULL;
   frame->temp    = temp_new_map ();
+  frame->tail_jumps = NULL;
+  frame->saved      = NULL;
+  frame->has_frame  = true;
 
   frame_stack = frm_new_frame_list (frame, frame_stack);
   //frame->locals_cnt  = 2; /* Return and frame pointer adress */
@@ -191,8 +207,8 @@ frm_alloc_local (frm_frame *frame_ptr,
   if (escape)
     {
       //access = in_frame (-(calc_offset (frame_ptr->locals_cnt++)));
-      // Locals start from %ebp - 4 - 12 (callee save)
-      int              offset = -4 - 12;
+      // Locals start from %ebp - 4
+      int              offset = -4;
       frm_access_list *locals = frame_ptr->locals;
       while (locals != NULL)
         {
@@ -269,9 +285,10 @@ in_frame (int offset)
 }
 
 static assem_instr_list *
-append_callee_save (assem_instr_list *il)
+append_callee_save (frm_frame        *frame,
+                    assem_instr_list *il)
 {
-  temp_temp_list *callee_saves = temp_reverse_list (frm_callee_saves ());
+  temp_temp_list *callee_saves = temp_reverse_list (frame->saved);
 
   assem_instr_list *ail = il;
   for (; callee_saves; callee_saves = callee_saves->tail)
@@ -287,17 +304,18 @@ append_callee_save (assem_instr_list *il)
 }
 
 static assem_instr_list *
-restore_callee_save (assem_instr_list *il)
+restore_callee_save (frm_frame        *frame,
+                     assem_instr_list *il)
 {
-  temp_temp_list *callee_saves = frm_callee_saves ();
+  temp_temp_list *callee_saves = frame->saved;
 
   assem_instr_list *ail = NULL;
   for (; callee_saves; callee_saves = callee_saves->tail)
     {
-      ail = assem_new_instr_list (assem_new_oper ("popl `s0\n",
-                                                  temp_new_temp_list (frm_sp (), NULL),
+      ail = assem_new_instr_list (assem_new_oper ("popl `d0\n",
                                                   temp_new_temp_list (callee_saves->head,
-                                                          NULL),
+                                                                      NULL),
+                                                  temp_new_temp_list (frm_sp (), NULL),
                                            NULL),
                            ail);
     }
@@ -362,27 +380,161 @@ frm_proc_entry_exit1 (frm_frame *frame_ptr,
 
 static temp_temp_list *return_sink = NULL;
 
-/* TODO: Make this code readable */
-assem_instr_list *
-frm_proc_entry_exit2 (assem_instr_list *body)
+/**
+ * Calculates the size of the stack frame above the callee saves.
+ * Every local in the frame (including spilled temps) needs 4 bytes.
+ *
+ * @param frame_ptr The frame.
+ *
+ * @return Frame size in bytes.
+ */
+static int
+frame_size (frm_frame *frame_ptr)
+{
+  int              size   = 0;
+  frm_access_list *locals = frame_ptr->locals;
+  for (; locals != NULL; locals = locals->tail)
+    {
+      if (locals->head->kind == IN_FRAME)
+        size += 4;
+    }
+  return size;
+}
+
+static temp_temp_list *
+get_return_sink (void)
 {
-  temp_temp_list *callee_saves = frm_callee_saves();
   if (!return_sink)
     return_sink = temp_new_temp_list (frm_ra(),
-                                 temp_new_temp_list (frm_sp (), callee_saves));
+                                 temp_new_temp_list (frm_sp (),
+                                                     frm_callee_saves ()));
+  return return_sink;
+}
+
+/**
+ * Restores the callee saves and releases the frame in front of il.
+ * leave also drops the local variables.
+ */
+static assem_instr_list *
+epilogue (frm_frame        *frame,
+          assem_instr_list *il)
+{
+  if (frame->has_frame)
+    {
+      assem_instr *leave = assem_new_oper ("leave\n",
+                                           temp_new_temp_list (frm_sp(),
+                                                               temp_new_temp_list (frm_fp(),
+                                                                                   NULL)),
+                                           temp_new_temp_list (frm_sp(), NULL),
+                                           NULL);
+      il = assem_new_instr_list (leave, il);
+    }
+  return restore_callee_save (frame, il);
+}
+
+/**
+ * Collects the callee saves the register allocator assigned to temps of the
+ * body and decides if the frame pointer has to be set up at all. It is not
+ * needed in a leaf function that neither has a local in the frame nor
+ * accesses its formals.
+ */
+static void
+scan_body (frm_frame        *frame,
+           assem_instr_list *body,
+           temp_map         *coloring)
+{
+  bool uses_fp = frame->tail_jumps != NULL;
+  bool calls   = false;
+  temp_temp_list *saved = NULL;
 
-  char inst_add[128];
-  int frame_size = 100;//frameSize(frame);
-  sprintf (inst_add, "addl $%d, `s0\n", frame_size);
+  for (; body; body = body->tail)
+    {
+      assem_instr    *inst = body->head;
+      temp_temp_list *tl   = NULL;
+      if (inst->kind == I_OPER)
+        {
+          tl = temp_union (inst->u.oper.dst, inst->u.oper.src);
+          if (strncmp (inst->u.oper.assem, "call ", 5) == 0)
+            calls = true;
+        }
+      else if (inst->kind == I_MOVE)
+        tl = temp_union (inst->u.move.dst, inst->u.move.src);
+
+      for (; tl; tl = tl->tail)
+        {
+          if (tl->head == fp)
+            uses_fp = true;
+
+          char *color = temp_lookup (coloring, tl->head);
+          if (color == NULL)
+            continue;
+
+          temp_temp_list *cs = frm_callee_saves ();
+          for (; cs; cs = cs->tail)
+            {
+              if (strcmp (color, temp_lookup (temp_name (), cs->head)) == 0
+                  && !temp_in_list (cs->head, saved))
+                saved = temp_new_temp_list (cs->head, saved);
+            }
+        }
+    }
 
-  return assem_splice (body,
-                       assem_new_instr_list (assem_new_oper (string_new (inst_add),
-                                                             temp_new_temp_list (frm_sp (),
-                                                                                 NULL),
-                                                             temp_new_temp_list (frm_sp (),
-                                                                                 NULL),
-                                                             NULL),
-                                      restore_callee_save (assem_new_instr_list (assem_new_oper ("leave\n", temp_new_temp_list (frm_sp(), temp_new_temp_list (frm_fp(), NULL)), temp_new_temp_list (frm_sp(), NULL), NULL), assem_new_instr_list (assem_new_oper ("ret\n", NULL, return_sink, NULL), NULL)))));
+  /* Keep the order of frm_callee_saves () */
+  frame->saved = temp_intersect (frm_callee_saves (), saved);
+  frame->has_frame = uses_fp || calls || frame_size (frame) > 0;
+}
+
+/**
+ * Creates the jump of a call that reuses the frame of the caller.
+ * frm_proc_entry_exit2() releases the frame in front of it.
+ *
+ * @param frame_ptr The frame of the caller.
+ * @param label_ptr The called function.
+ *
+ * @return The jump instruction.
+ */
+assem_instr *
+frm_tail_jump (frm_frame  *frame_ptr,
+               temp_label *label_ptr)
+{
+  char *inst = new (sizeof (char) * 128);
+  sprintf (inst, "jmp %s\n", temp_label_str (label_ptr));
+
+  /*
+    Has no targets in this function, so the flow ends here. The arguments
+    are already stored in the frame and the callee saves get restored after
+    register allocation, so no temp is live at the jump.
+  */
+  assem_instr *jump = assem_new_oper (inst,
+                                      NULL,
+                                      temp_new_temp_list (frm_sp (), NULL),
+                                      assem_new_uncond_targets (NULL));
+  frame_ptr->tail_jumps = assem_new_instr_list (jump, frame_ptr->tail_jumps);
+  return jump;
+}
+
+assem_instr_list *
+frm_proc_entry_exit2 (frm_frame        *frame,
+                      assem_instr_list *body,
+                      temp_map         *coloring)
+{
+  scan_body (frame, body, coloring);
+
+  /* Release the frame before every tail call */
+  assem_instr_list *il = body, *prev = NULL;
+  for (; il; prev = il, il = il->tail)
+    {
+      if (!assem_instr_in_list (il->head, frame->tail_jumps))
+        continue;
+
+      if (prev == NULL)
+        body = epilogue (frame, il);
+      else
+        prev->tail = epilogue (frame, il);
+    }
+
+  assem_instr *ret = assem_new_oper ("ret\n", NULL, get_return_sink (), NULL);
+  return assem_splice (body, epilogue (frame, assem_new_instr_list (ret, NULL)));
 }
 
 assem_proc *
@@ -390,20 +542,26 @@ frm_proc_entry_exit3 (frm_frame        *frame,
                       assem_instr_list *body)
 {
   char buf[1024], inst_lbl[128], inst_sub[128];
-  int frame_size = 100;//frameSize(frame);
 
   sprintf(buf, "# PROCEDURE %s\n", sym_name (frame->start_label));
   sprintf(inst_lbl, "%s:\n", sym_name(frame->start_label));
-  // sprintf(buf, "%s    pushl %%ebp\n", buf);
-  // sprintf(buf, "%s    movl %%esp, %%ebp\n", buf);
-  sprintf(inst_sub, "subl $%d, `s0\n", frame_size);
 
+  body = append_callee_save (frame, body);
+  if (frame->has_frame)
+    {
+      int size = frame_size (frame);
+      if (size > 0)
+        {
+          sprintf(inst_sub, "subl $%d, `s0\n", size);
+          body = assem_new_instr_list (assem_new_oper (string_new (inst_sub), temp_new_temp_list (frm_sp(), NULL), temp_new_temp_list (frm_sp(), NULL), NULL),
+                   body);
+        }
+      body = assem_new_instr_list (assem_new_oper ("pushl `s0\n", temp_new_temp_list (frm_fp(), temp_new_temp_list (frm_sp(), NULL)), temp_new_temp_list (frm_fp(), NULL), NULL),
+               assem_new_instr_list (assem_new_move ("movl `s0, `d0\n", temp_new_temp_list (frm_fp(), NULL), temp_new_temp_list (frm_sp(), NULL)),
+                 body));
+    }
   body = assem_new_instr_list (assem_new_label(string_new (inst_lbl), frame->start_label),
-            assem_new_instr_list (assem_new_oper ("pushl `s0\n", temp_new_temp_list (frm_fp(), temp_new_temp_list (frm_sp(), NULL)), temp_new_temp_list (frm_fp(), NULL), NULL),
-              assem_new_instr_list (assem_new_move ("movl `s0, `d0\n", temp_new_temp_list (frm_fp(), NULL), temp_new_temp_list (frm_sp(), NULL)),
-                append_callee_save(
-                                   assem_new_instr_list (assem_new_oper (string_new (inst_sub), temp_new_temp_list (frm_sp(), NULL), temp_new_temp_list (frm_sp(), NULL), NULL),
-                                  body)))));
+                               body);
   return assem_new_proc (string_new (buf), body, "# END\n");
 }
 